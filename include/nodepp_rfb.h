@@ -23,6 +23,7 @@
 #pragma once
 
 #include <boost/utility/string_ref.hpp>
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -36,12 +37,23 @@ namespace daw {
 
 		namespace impl {
 			class RFBServerImpl;
+			class RFBSessionHostImpl;
 		} // namespace impl
 
 		namespace BitDepth {
 			enum values : uint8_t { eight = 8, sixteen = 16, thirtytwo = 32 };
 		} // namespace BitDepth
 
+		namespace ReplaySpeed {
+			enum values : uint8_t { real_time, maximum };
+		} // namespace ReplaySpeed
+
+		struct ReplayStats {
+			size_t messages;
+			size_t bytes;
+			std::chrono::microseconds elapsed;
+		}; // struct ReplayStats
+
 		union ButtonMask {
 			uint8_t value;
 			struct {
@@ -67,9 +79,14 @@ namespace daw {
 		using Box = std::vector<daw::range::Range<uint8_t *>>;
 		using BoxReadOnly = std::vector<daw::range::Range<uint8_t const *>>;
 
+		class RFBSessionHost;
+
 		class RFBServer {
 			std::shared_ptr<impl::RFBServerImpl> m_impl;
 
+			explicit RFBServer( std::shared_ptr<impl::RFBServerImpl> server_impl );
+			friend class RFBSessionHost;
+
 		  public:
 			RFBServer( ) = delete;
 			~RFBServer( );
@@ -94,7 +111,25 @@ namespace daw {
 			    std::function<void( ButtonMask buttons, uint16_t x_position, uint16_t y_position )> callback );
 			void on_client_clipboard_text( std::function<void( daw::string_view text )> callback );
 
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: choose, when a client connects, how many times smaller than
+			/// the framebuffer its view is.  The client is given the reduced size,
+			/// updates are downscaled before they are sent and its pointer events
+			/// are mapped back to framebuffer coordinates.  The default is 1
+			void on_client_scale(
+			    std::function<uint8_t( std::string const &remote_address, uint16_t remote_port )> callback );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: send text to the clients' clipboards unless it is what was
+			/// last sent.  Clients supporting the Extended Clipboard are sent the
+			/// compressed text when it is within the size they accept unasked,
+			/// otherwise they are notified and receive it when they ask for it
 			void send_clipboard_text( daw::string_view text );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: the largest clipboard text accepted from a client, larger
+			/// text is read and discarded.  The default is 16MiB
+			void set_max_clipboard_size( size_t size );
 			void send_bell( );
 			//////////////////////////////////////////////////////////////////////////
 			/// Summary: get a bounded area that will later be updated to the client
@@ -104,6 +139,71 @@ namespace daw {
 			//////////////////////////////////////////////////////////////////////////
 			/// Summary: send all updated areas to client
 			void update( );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: replace palette entries starting at first_colour and send
+			/// them to the clients shown palette indices.  Clients that asked for true
+			/// colour are sent the whole framebuffer on the next update.  Only 8bpp
+			/// framebuffers, whose pixels are palette indices, have a palette
+			void set_palette( uint8_t first_colour, std::vector<Colour> const &colours );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: record the session to a memory mapped file with a copy of
+			/// the framebuffer every keyframe_interval.  Messages received are
+			/// recorded as is, messages sent are recorded once in the framebuffer's
+			/// own format as described in rfb_recording.h
+			void start_recording( std::string file_name,
+			                      std::chrono::seconds keyframe_interval = std::chrono::seconds( 10 ) );
+			void stop_recording( );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: send a recording to the connected clients starting at the
+			/// last keyframe before start_at.  Blocks until the recording has been
+			/// sent.  Recorded client input is not replayed, the framebuffer is not
+			/// changed and replayed messages are not recorded
+			ReplayStats replay( std::string const &file_name, ReplaySpeed::values speed,
+			                    std::chrono::microseconds start_at = std::chrono::microseconds( 0 ) );
 		}; // class RFBServer
+
+		//////////////////////////////////////////////////////////////////////////
+		/// Summary: accept clients on one port and hand them to one of many
+		/// sessions once the handshake is complete.  Sessions share the service
+		/// loop and message buffers of the host and do not listen themselves
+		class RFBSessionHost {
+			std::shared_ptr<impl::RFBSessionHostImpl> m_impl;
+
+		  public:
+			~RFBSessionHost( );
+			RFBSessionHost( RFBSessionHost const & ) = default;
+			RFBSessionHost &operator=( RFBSessionHost const & ) = default;
+			RFBSessionHost( RFBSessionHost && ) noexcept = default;
+			RFBSessionHost &operator=( RFBSessionHost && ) noexcept = default;
+
+			explicit RFBSessionHost(
+			    daw::nodepp::base::EventEmitter emitter = daw::nodepp::base::create_event_emitter( ) );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: add a session, the first session added is where clients are
+			/// routed when no router is set
+			RFBServer create_session( std::string name, uint16_t width, uint16_t height, BitDepth::values depth );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: remove a session and close its clients
+			void remove_session( std::string const &name );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: choose the session name for a client after the handshake.
+			/// Clients routed to an unknown session are closed.
+			/// Limitation: RFB 3.3 carries no session name and the host offers no
+			/// way to send one, so the client cannot pick its session.  Routing is
+			/// by the client's address and source port, which suits a fixed mapping
+			/// of machines to sessions.  Where the viewer must choose, serve each
+			/// session on its own port with RFBServer::listen instead
+			void on_route(
+			    std::function<std::string( std::string const &remote_address, uint16_t remote_port )> router );
+
+			void listen( uint16_t port, daw::nodepp::lib::net::ip_version ip_ver );
+			void close( );
+		}; // class RFBSessionHost
 	}      // namespace rfb
 } // namespace daw
@@ -0,0 +1,165 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2017 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace daw {
+	namespace rfb {
+		namespace impl {
+			struct ClientId {
+				uint32_t index;
+				uint32_t generation;
+
+				constexpr ClientId( ) noexcept : index{0}, generation{0} {}
+				constexpr ClientId( uint32_t idx, uint32_t gen ) noexcept : index{idx}, generation{gen} {}
+			}; // struct ClientId
+
+			constexpr bool operator==( ClientId const &lhs, ClientId const &rhs ) noexcept {
+				return lhs.index == rhs.index && lhs.generation == rhs.generation;
+			}
+
+			constexpr bool operator!=( ClientId const &lhs, ClientId const &rhs ) noexcept {
+				return !( lhs == rhs );
+			}
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: the connected clients of a server.  Clients are kept
+			/// densely packed so that broadcasting is a loop over contiguous memory,
+			/// and a slot array maps stable ids to their current position.  A
+			/// slot's generation is bumped when it is freed so stale ids are never
+			/// mistaken for a newer client.  Add, remove and find are O(1)
+			template<typename Client>
+			class ClientRegistry {
+				struct Slot {
+					uint32_t dense_index;
+					uint32_t generation;
+				}; // struct Slot
+
+				std::vector<Client> m_clients;
+				std::vector<uint32_t> m_client_slots;
+				std::vector<Slot> m_slots;
+				std::vector<uint32_t> m_free_slots;
+
+				bool is_valid( ClientId id ) const noexcept {
+					return id.index < m_slots.size( ) && m_slots[id.index].generation == id.generation &&
+					       m_slots[id.index].dense_index < m_clients.size( ) &&
+					       m_client_slots[m_slots[id.index].dense_index] == id.index;
+				}
+
+			  public:
+				ClientRegistry( ) = default;
+
+				ClientId add( Client client ) {
+					uint32_t slot_index;
+					if( m_free_slots.empty( ) ) {
+						slot_index = static_cast<uint32_t>( m_slots.size( ) );
+						m_slots.push_back( {0, 1} );
+					} else {
+						slot_index = m_free_slots.back( );
+						m_free_slots.pop_back( );
+					}
+					auto &slot = m_slots[slot_index];
+					slot.dense_index = static_cast<uint32_t>( m_clients.size( ) );
+					m_clients.push_back( std::move( client ) );
+					m_client_slots.push_back( slot_index );
+					return ClientId{slot_index, slot.generation};
+				}
+
+				bool remove( ClientId id ) {
+					if( !is_valid( id ) ) {
+						return false;
+					}
+					auto &slot = m_slots[id.index];
+					auto const last = static_cast<uint32_t>( m_clients.size( ) - 1 );
+					if( slot.dense_index != last ) {
+						// Move the last client into the hole so clients stay contiguous
+						m_clients[slot.dense_index] = std::move( m_clients[last] );
+						m_client_slots[slot.dense_index] = m_client_slots[last];
+						m_slots[m_client_slots[last]].dense_index = slot.dense_index;
+					}
+					m_clients.pop_back( );
+					m_client_slots.pop_back( );
+					++slot.generation;
+					m_free_slots.push_back( id.index );
+					return true;
+				}
+
+				Client *find( ClientId id ) noexcept {
+					if( !is_valid( id ) ) {
+						return nullptr;
+					}
+					return &m_clients[m_slots[id.index].dense_index];
+				}
+
+				Client const *find( ClientId id ) const noexcept {
+					if( !is_valid( id ) ) {
+						return nullptr;
+					}
+					return &m_clients[m_slots[id.index].dense_index];
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: call f( client ) for every client.  Clients must not be
+				/// added or removed from within f
+				template<typename Func>
+				void for_each( Func f ) {
+					for( auto &client : m_clients ) {
+						f( client );
+					}
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: call f( client ) for every client but the one specified
+				template<typename Func>
+				void for_each_except( ClientId id, Func f ) {
+					auto const skip = is_valid( id ) ? m_slots[id.index].dense_index : m_clients.size( );
+					for( size_t n = 0; n < m_clients.size( ); ++n ) {
+						if( n != skip ) {
+							f( m_clients[n] );
+						}
+					}
+				}
+
+				size_t size( ) const noexcept {
+					return m_clients.size( );
+				}
+
+				bool empty( ) const noexcept {
+					return m_clients.empty( );
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: release memory held for clients that have left
+				void shrink_to_fit( ) {
+					m_clients.shrink_to_fit( );
+					m_client_slots.shrink_to_fit( );
+					m_free_slots.shrink_to_fit( );
+				}
+			}; // class ClientRegistry
+		}      // namespace impl
+	}          // namespace rfb
+} // namespace daw
@@ -0,0 +1,117 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2017 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <daw/daw_string_view.h>
+
+namespace daw {
+	namespace rfb {
+		namespace impl {
+			constexpr uint64_t fnv1a_hash( char const *first, char const *last ) noexcept {
+				uint64_t hash = 14695981039346656037ULL;
+				for( ; first != last; ++first ) {
+					hash = ( hash ^ static_cast<uint8_t>( *first ) ) * 1099511628211ULL;
+				}
+				return hash;
+			}
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: a ClientCutText message that is larger than one read.  Text
+			/// over the size limit is read and discarded
+			struct CutTextTransfer {
+				std::string data;
+				size_t remaining;
+				bool extended;
+				bool discard;
+
+				CutTextTransfer( ) : data{}, remaining{0}, extended{false}, discard{false} {}
+
+				CutTextTransfer( size_t size, bool is_extended, size_t max_size )
+				    : data{}, remaining{size}, extended{is_extended}, discard{size > max_size} {
+
+					if( !discard ) {
+						data.reserve( size );
+					}
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: add data to the transfer and return how much of it was used
+				size_t add( char const *first, size_t size ) {
+					auto const consumed = std::min( size, remaining );
+					if( !discard ) {
+						data.append( first, consumed );
+					}
+					remaining -= consumed;
+					return consumed;
+				}
+
+				bool complete( ) const noexcept {
+					return remaining == 0;
+				}
+			}; // struct CutTextTransfer
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: the text on the server's clipboard.  The hash of the text is
+			/// kept so that most changed text is found without comparing it
+			class ClipboardText {
+				std::string m_text;
+				uint64_t m_hash;    // Zero until text is assigned
+				uint64_t m_version; // Changes each time the text does
+
+			  public:
+				ClipboardText( ) : m_text{}, m_hash{0}, m_version{0} {}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: replace the text, false is returned when it is unchanged
+				bool assign( daw::string_view text ) {
+					auto const hash = std::max<uint64_t>( fnv1a_hash( text.begin( ), text.end( ) ), 1 );
+					if( hash == m_hash && text.size( ) == m_text.size( ) &&
+					    std::equal( text.begin( ), text.end( ), m_text.begin( ) ) ) {
+						return false;
+					}
+					m_text.assign( text.begin( ), text.end( ) );
+					m_hash = hash;
+					++m_version;
+					return true;
+				}
+
+				bool has_text( ) const noexcept {
+					return m_hash != 0;
+				}
+
+				std::string const &text( ) const noexcept {
+					return m_text;
+				}
+
+				uint64_t version( ) const noexcept {
+					return m_version;
+				}
+			}; // class ClipboardText
+		}      // namespace impl
+	}          // namespace rfb
+} // namespace daw
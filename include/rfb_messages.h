@@ -38,9 +38,9 @@ namespace daw {
 					uint16_t red_max;
 					uint16_t green_max;
 					uint16_t blue_max;
-					uint16_t red_shift;
-					uint16_t green_shift;
-					uint16_t blue_shift;
+					uint8_t red_shift;
+					uint8_t green_shift;
+					uint8_t blue_shift;
 					uint8_t padding[3];
 
 					constexpr pixel_format_t( ) noexcept
@@ -60,6 +60,20 @@ namespace daw {
 				constexpr ServerInitialisationMsg( ) noexcept: width{0}, height{0} {}
 			}; // struct ServerInitialisation
 
+			struct ServerSetColourMapEntriesMsg {
+				uint8_t message_type; // Always 1
+				uint8_t padding;
+				uint16_t first_colour;
+				uint16_t number_of_colours;
+				// Send number_of_colours red, green, blue uint16_t triples after
+			}; // struct ServerSetColourMapEntriesMsg
+
+			struct ClientSetPixelFormatMsg {
+				uint8_t message_type; // Always 0
+				uint8_t padding[3];
+				ServerInitialisationMsg::pixel_format_t pixel_format;
+			}; // struct ClientSetPixelFormatMsg
+
 			struct ClientFrameBufferUpdateRequestMsg {
 				uint8_t message_type; // Always 3
 				uint8_t incremental;
@@ -0,0 +1,96 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2017 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "nodepp_rfb.h"
+
+namespace daw {
+	namespace rfb {
+		namespace impl {
+			struct Update {
+				uint16_t x;
+				uint16_t y;
+				uint16_t width;
+				uint16_t height;
+			}; // struct Update
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: the part of a scaled client's view covering an update.  The
+			/// view is width x height, an update outside of it has no width
+			inline Update scale_update( Update const &u, size_t scale, size_t width, size_t height ) noexcept {
+				auto const x1 = u.x / scale;
+				auto const y1 = u.y / scale;
+				auto const x2 = std::min( ( u.x + u.width + scale - 1 ) / scale, width );
+				auto const y2 = std::min( ( u.y + u.height + scale - 1 ) / scale, height );
+				if( x2 <= x1 || y2 <= y1 ) {
+					return Update{0, 0, 0, 0};
+				}
+				return Update{static_cast<uint16_t>( x1 ), static_cast<uint16_t>( y1 ),
+				              static_cast<uint16_t>( x2 - x1 ), static_cast<uint16_t>( y2 - y1 )};
+			}
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: lookup tables mapping each channel to its contribution to
+			/// the index of the nearest colour in the default palette's cube
+			struct ColourCubeQuantizer {
+				std::array<uint8_t, 256> red;
+				std::array<uint8_t, 256> green;
+				std::array<uint8_t, 256> blue;
+
+				ColourCubeQuantizer( ) noexcept : red{}, green{}, blue{} {
+					for( size_t n = 0; n < 256; ++n ) {
+						auto const level = static_cast<uint8_t>( ( n * 5 + 127 ) / 255 );
+						red[n] = static_cast<uint8_t>( level * 36 );
+						green[n] = static_cast<uint8_t>( level * 6 );
+						blue[n] = level;
+					}
+				}
+
+				uint8_t operator( )( uint8_t r, uint8_t g, uint8_t b ) const noexcept {
+					return static_cast<uint8_t>( red[r] + green[g] + blue[b] );
+				}
+			}; // struct ColourCubeQuantizer
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: append the 32bpp pixels in [first, last) as default palette
+			/// indices
+			template<typename Iterator, typename Container>
+			void append_quantized( Iterator first, Iterator last, Container &destination ) {
+				static ColourCubeQuantizer const quantizer{};
+				auto const count = static_cast<size_t>( std::distance( first, last ) ) / sizeof( Colour );
+				auto const pos = destination.size( );
+				destination.resize( pos + count );
+				auto out = destination.begin( ) + static_cast<std::ptrdiff_t>( pos );
+				for( size_t n = 0; n < count; ++n, first += sizeof( Colour ) ) {
+					*out++ = static_cast<typename Container::value_type>( quantizer( first[0], first[1], first[2] ) );
+				}
+			}
+		} // namespace impl
+	}     // namespace rfb
+} // namespace daw
@@ -0,0 +1,144 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2017 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace daw {
+	namespace rfb {
+		//////////////////////////////////////////////////////////////////////////
+		/// Recording file format, the headers are in host byte order and the
+		/// payloads are RFB messages in network byte order
+		///
+		/// RecordingFileHeader
+		/// RecordHeader, payload[RecordHeader::size]
+		/// RecordHeader, payload[RecordHeader::size]
+		/// ...
+		///
+		/// Server to client payloads are the session as a client using the
+		/// framebuffer's own pixel format and size would see it, not the bytes
+		/// written to any one client.  They are recorded once however many
+		/// clients are connected:
+		///   FramebufferUpdate, raw rectangles in the framebuffer's format unscaled
+		///   SetColourMapEntries, when the palette is changed
+		///   Bell
+		///   ServerCutText, clipboard text in the plain form even when every
+		///   client uses the Extended Clipboard
+		/// Messages that depend on a client are not recorded.  These are the
+		/// ServerInit, the colour map sent on connecting or after SetPixelFormat,
+		/// and the Extended Clipboard caps, notify, request and provide messages.
+		/// Client to server payloads are the exact bytes received from a client.
+		/// Keyframe payloads are a copy of the raw framebuffer at that time and
+		/// are what seeking is done against.  The file is grown in chunks while
+		/// recording and RecordingFileHeader::data_size marks the end of the
+		/// last complete record, so a file from an interrupted session is
+		/// still readable.
+		namespace RecordDirection {
+			enum values : uint8_t { server_to_client = 0, client_to_server = 1, keyframe = 2 };
+		} // namespace RecordDirection
+
+		struct RecordingFileHeader {
+			char magic[8]; // Always "NPPRFBRC"
+			uint32_t version;
+			uint16_t width;
+			uint16_t height;
+			uint8_t bit_depth;
+			uint8_t padding[7];
+			uint64_t data_size; // Bytes of records following the header
+		};                      // struct RecordingFileHeader
+
+		struct RecordHeader {
+			uint64_t timestamp; // Microseconds since recording started
+			uint32_t size;
+			uint8_t direction;
+			uint8_t padding[3];
+		}; // struct RecordHeader
+
+		class SessionRecorder {
+			std::mutex m_mutex;
+			std::string m_file_name;
+			boost::iostreams::mapped_file m_file;
+			size_t m_position;
+			std::chrono::steady_clock::time_point m_start;
+			std::chrono::microseconds m_keyframe_interval;
+			std::chrono::microseconds m_last_keyframe;
+
+			RecordingFileHeader &header( ) noexcept;
+			void reserve( size_t additional_size );
+
+		  public:
+			SessionRecorder( std::string file_name, uint16_t width, uint16_t height, uint8_t bit_depth,
+			                 std::chrono::microseconds keyframe_interval );
+			~SessionRecorder( );
+
+			SessionRecorder( SessionRecorder const & ) = delete;
+			SessionRecorder &operator=( SessionRecorder const & ) = delete;
+			SessionRecorder( SessionRecorder && ) = delete;
+			SessionRecorder &operator=( SessionRecorder && ) = delete;
+
+			void append( RecordDirection::values direction, uint8_t const *data, size_t size );
+			std::chrono::microseconds elapsed( ) const;
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: true when no keyframe has been appended within the
+			/// keyframe interval
+			bool keyframe_due( );
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: truncate the file to the recorded size and unmap it
+			void close( );
+		}; // class SessionRecorder
+
+		struct Record {
+			std::chrono::microseconds timestamp;
+			RecordDirection::values direction;
+			uint8_t const *data;
+			size_t size;
+		}; // struct Record
+
+		class SessionRecording {
+			boost::iostreams::mapped_file_source m_file;
+			RecordingFileHeader m_header;
+			std::vector<Record> m_records;
+			std::vector<size_t> m_keyframes;
+
+		  public:
+			explicit SessionRecording( std::string const &file_name );
+
+			uint16_t width( ) const noexcept;
+			uint16_t height( ) const noexcept;
+			uint8_t bit_depth( ) const noexcept;
+			std::vector<Record> const &records( ) const noexcept;
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: index of the last keyframe at or before timestamp, or 0 if
+			/// there is none
+			size_t seek( std::chrono::microseconds timestamp ) const;
+		}; // class SessionRecording
+	}      // namespace rfb
+} // namespace daw
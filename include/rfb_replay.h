@@ -0,0 +1,89 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2017 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "rfb_pixels.h"
+#include "rfb_recording.h"
+
+namespace daw {
+	namespace rfb {
+		namespace impl {
+			inline uint16_t read_network_uint16( uint8_t const *data ) noexcept {
+				return static_cast<uint16_t>( ( data[0] << 8u ) | data[1] );
+			}
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: copy a keyframe into the framebuffer, false is returned when
+			/// it is not the size of the framebuffer
+			inline bool restore_keyframe( Record const &rec, std::vector<uint8_t> &framebuffer ) {
+				if( rec.size != framebuffer.size( ) ) {
+					return false;
+				}
+				std::copy( rec.data, rec.data + rec.size, framebuffer.begin( ) );
+				return true;
+			}
+
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: copy the raw rectangles of a recorded FramebufferUpdate into
+			/// a framebuffer of width by height pixels and add them to areas.  False
+			/// is returned when the message is cut short or a rectangle lies outside
+			/// of the framebuffer, rectangles before it have been applied
+			inline bool apply_update_message( Record const &rec, uint16_t width, uint16_t height,
+			                                  size_t bytes_per_pixel, std::vector<uint8_t> &framebuffer,
+			                                  std::vector<Update> &areas ) {
+				size_t const header_size = 4;
+				size_t const rect_header_size = 12; // x, y, width, height and encoding type
+				if( rec.size < header_size ) {
+					return false;
+				}
+				auto const count = read_network_uint16( rec.data + 2 );
+				size_t pos = header_size;
+				for( size_t n = 0; n < count; ++n ) {
+					if( rec.size - pos < rect_header_size ) {
+						return false;
+					}
+					auto const rect = rec.data + pos;
+					Update const u{read_network_uint16( rect ), read_network_uint16( rect + 2 ),
+					               read_network_uint16( rect + 4 ), read_network_uint16( rect + 6 )};
+					pos += rect_header_size;
+					auto const row_size = u.width * bytes_per_pixel;
+					if( u.x + u.width > width || u.y + u.height > height || rec.size - pos < row_size * u.height ) {
+						return false;
+					}
+					for( size_t row = u.y; row < u.y + u.height; ++row, pos += row_size ) {
+						std::copy( rec.data + pos, rec.data + pos + row_size,
+						           framebuffer.begin( ) +
+						               static_cast<std::ptrdiff_t>( ( ( row * width ) + u.x ) * bytes_per_pixel ) );
+					}
+					areas.push_back( u );
+				}
+				return true;
+			}
+		} // namespace impl
+	}     // namespace rfb
+} // namespace daw
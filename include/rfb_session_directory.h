@@ -0,0 +1,116 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2017 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <daw/daw_exception.h>
+
+namespace daw {
+	namespace rfb {
+		namespace impl {
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: the named sessions of a host and the choice of session for
+			/// each new client.  The first session added is where clients go when
+			/// there is no router, a client routed to an unknown session is closed
+			template<typename Session>
+			class SessionDirectory {
+			  public:
+				using router_t = std::function<std::string( std::string const &remote_address, uint16_t remote_port )>;
+
+			  private:
+				std::mutex m_mutex;
+				std::unordered_map<std::string, std::shared_ptr<Session>> m_sessions;
+				std::string m_default_session;
+				router_t m_router;
+
+			  public:
+				SessionDirectory( ) : m_mutex{}, m_sessions{}, m_default_session{}, m_router{} {}
+
+				void add( std::string name, std::shared_ptr<Session> session ) {
+					std::lock_guard<std::mutex> lock{m_mutex};
+					daw::exception::daw_throw_on_false( m_sessions.count( name ) == 0, "Session already exists" );
+					if( m_sessions.empty( ) ) {
+						m_default_session = name;
+					}
+					m_sessions.emplace( std::move( name ), std::move( session ) );
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: remove the session and close the clients attached to it
+				void remove( std::string const &name ) {
+					std::shared_ptr<Session> session;
+					{
+						std::lock_guard<std::mutex> lock{m_mutex};
+						auto pos = m_sessions.find( name );
+						if( pos == m_sessions.end( ) ) {
+							return;
+						}
+						session = std::move( pos->second );
+						m_sessions.erase( pos );
+					}
+					session->close_clients( );
+				}
+
+				void on_route( router_t router ) {
+					std::lock_guard<std::mutex> lock{m_mutex};
+					m_router = std::move( router );
+				}
+
+				template<typename Socket>
+				void route( Socket socket, bool shared ) {
+					router_t router;
+					std::string name;
+					{
+						std::lock_guard<std::mutex> lock{m_mutex};
+						router = m_router;
+						name = m_default_session;
+					}
+					// The router is user code and may take a while, so it is called without holding the lock
+					if( router ) {
+						name = router( socket->remote_address( ), socket->remote_port( ) );
+					}
+					std::shared_ptr<Session> session;
+					{
+						std::lock_guard<std::mutex> lock{m_mutex};
+						auto pos = m_sessions.find( name );
+						if( pos != m_sessions.end( ) ) {
+							session = pos->second;
+						}
+					}
+					if( !session ) {
+						socket->close( );
+						return;
+					}
+					session->attach_client( std::move( socket ), shared );
+				}
+			}; // class SessionDirectory
+		}      // namespace impl
+	}          // namespace rfb
+} // namespace daw
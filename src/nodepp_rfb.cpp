@@ -20,8 +20,21 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include <daw/daw_exception.h>
@@ -30,7 +43,13 @@
 #include <daw/nodepp/lib_net_socket_stream.h>
 
 #include "nodepp_rfb.h"
+#include "rfb_client_registry.h"
+#include "rfb_clipboard.h"
 #include "rfb_messages.h"
+#include "rfb_pixels.h"
+#include "rfb_recording.h"
+#include "rfb_replay.h"
+#include "rfb_session_directory.h"
 
 namespace daw {
 	namespace rfb {
@@ -48,21 +67,82 @@ namespace daw {
 					}
 				}
 
-				template<typename Collection, typename Func>
-				void process_all( Collection &&values, Func f ) {
-					while( !values.empty( ) ) {
-						f( values.back( ) );
-						values.pop_back( );
+				struct ClientFormat {
+					uint8_t scale;      // Framebuffer is this many times larger than the client's view
+					bool colour_mapped; // Client asked for 8bpp indices into the palette
+					bool translated;    // Client asked for 32bpp pixels laid out differently to the framebuffer
+					uint8_t red_byte;   // Byte of a translated pixel holding each channel
+					uint8_t green_byte;
+					uint8_t blue_byte;
+				}; // struct ClientFormat
+
+				constexpr bool operator==( ClientFormat const &lhs, ClientFormat const &rhs ) noexcept {
+					return lhs.scale == rhs.scale && lhs.colour_mapped == rhs.colour_mapped &&
+					       lhs.translated == rhs.translated && lhs.red_byte == rhs.red_byte &&
+					       lhs.green_byte == rhs.green_byte && lhs.blue_byte == rhs.blue_byte;
+				}
+
+				namespace ExtendedClipboard {
+					constexpr int32_t const pseudo_encoding = static_cast<int32_t>( 0xC0A1E5CE );
+					constexpr uint32_t const max_unsolicited_text_size = 64 * 1024;
+					// What a client is assumed to handle until it sends its caps
+					constexpr uint32_t const default_client_text_size = 20 * 1024 * 1024;
+
+					enum values : uint32_t {
+						text = 1u,
+						caps = 1u << 24u,
+						request = 1u << 25u,
+						peek = 1u << 26u,
+						notify = 1u << 27u,
+						provide = 1u << 28u
+					};
+
+					constexpr uint32_t const default_client_caps = text | request | notify | provide;
+				} // namespace ExtendedClipboard
+
+				struct Client {
+					daw::nodepp::lib::net::NetSocketStream socket;
+					ClientFormat format;
+					bool extended_clipboard;
+					uint32_t clipboard_caps; // Extended Clipboard actions and formats the client handles
+					uint32_t max_text_size;  // Largest text the client takes without asking for it
+					CutTextTransfer cut_text;
+					daw::nodepp::base::data_t pending; // Start of a message whose remainder is in a later read
+				}; // struct Client
+
+				std::vector<char> zlib_compress( char const *data, size_t size ) {
+					std::vector<char> result;
+					{
+						boost::iostreams::filtering_ostream out;
+						out.push( boost::iostreams::zlib_compressor{} );
+						out.push( boost::iostreams::back_inserter( result ) );
+						out.write( data, static_cast<std::streamsize>( size ) );
 					}
+					return result;
 				}
 
-				struct Update {
-					uint16_t x;
-					uint16_t y;
-					uint16_t width;
-					uint16_t height;
-				}; // struct Update
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: inflate data, giving up once the output exceeds max_size
+				bool zlib_decompress( char const *data, size_t size, size_t max_size, std::string &result ) {
+					boost::iostreams::filtering_istream in;
+					in.push( boost::iostreams::zlib_decompressor{} );
+					in.push( boost::iostreams::array_source{data, size} );
+					std::array<char, 4096> chunk;
+					auto const chunk_size = static_cast<std::streamsize>( chunk.size( ) );
+					try {
+						while( in.read( chunk.data( ), chunk_size ), in.gcount( ) > 0 ) {
+							result.append( chunk.data( ), static_cast<size_t>( in.gcount( ) ) );
+							if( result.size( ) > max_size ) {
+								return false;
+							}
+						}
+					} catch( boost::iostreams::zlib_error const & ) { return false; }
+					return true;
+				}
 
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: the server initialisation message in host byte order so that
+				/// it can be compared with client pixel formats.  It is converted when sent
 				ServerInitialisationMsg create_server_initialization_message( uint16_t width, uint16_t height,
 				                                                              uint8_t depth ) {
 					ServerInitialisationMsg result{};
@@ -70,10 +150,56 @@ namespace daw {
 					result.height = height;
 					result.pixel_format.bpp = depth;
 					result.pixel_format.depth = depth;
-					result.pixel_format.true_colour_flag = static_cast<uint8_t>( true );
-					result.pixel_format.red_max = 255;
-					result.pixel_format.blue_max = 255;
-					result.pixel_format.green_max = 255;
+					switch( depth ) {
+					case 8:
+						// Pixels are indices into the colour map
+						result.pixel_format.true_colour_flag = static_cast<uint8_t>( false );
+						break;
+					case 16:
+						result.pixel_format.true_colour_flag = static_cast<uint8_t>( true );
+						result.pixel_format.red_max = 31;
+						result.pixel_format.green_max = 63;
+						result.pixel_format.blue_max = 31;
+						result.pixel_format.red_shift = 11;
+						result.pixel_format.green_shift = 5;
+						result.pixel_format.blue_shift = 0;
+						break;
+					case 32:
+					default:
+						// Matches the memory layout of Colour
+						result.pixel_format.depth = 24;
+						result.pixel_format.true_colour_flag = static_cast<uint8_t>( true );
+						result.pixel_format.red_max = 255;
+						result.pixel_format.green_max = 255;
+						result.pixel_format.blue_max = 255;
+						result.pixel_format.red_shift = 0;
+						result.pixel_format.green_shift = 8;
+						result.pixel_format.blue_shift = 16;
+						break;
+					}
+					return result;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: a 6x6x6 colour cube followed by a grey ramp.  This is the
+				/// initial colour map of 8bpp framebuffers and the colour map used when
+				/// a 32bpp framebuffer is sent to a colour mapped client
+				std::array<Colour, 256> create_default_palette( ) {
+					std::array<Colour, 256> result{};
+					size_t n = 0;
+					for( uint8_t red = 0; red < 6; ++red ) {
+						for( uint8_t green = 0; green < 6; ++green ) {
+							for( uint8_t blue = 0; blue < 6; ++blue ) {
+								result[n++] = Colour{static_cast<uint8_t>( red * 51 ),
+								                     static_cast<uint8_t>( green * 51 ),
+								                     static_cast<uint8_t>( blue * 51 ), 0};
+							}
+						}
+					}
+					for( size_t grey = 1; n < result.size( ); ++n, ++grey ) {
+						auto const value = static_cast<uint8_t>( ( grey * 255 ) / 41 );
+						result[n] = Colour{value, value, value, 0};
+					}
 					return result;
 				}
 
@@ -89,6 +215,28 @@ namespace daw {
 					return result;
 				}
 
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: convert an integer between host and network (big endian)
+				/// byte order.  The conversion is its own inverse
+				template<typename T>
+				T network_byte_order( T const value ) noexcept {
+					static_assert(::daw::traits::is_integral_v<T>,
+					               "Parameter to network_byte_order must be an Integral type" );
+					using unsigned_t = std::make_unsigned_t<T>;
+					std::array<uint8_t, sizeof( T )> bytes;
+					std::memcpy( bytes.data( ), &value, sizeof( T ) );
+					unsigned_t result = 0;
+					for( auto const b : bytes ) {
+						result = static_cast<unsigned_t>( ( result << 8u ) | b );
+					}
+					return static_cast<T>( result );
+				}
+
+				Update network_byte_order( Update const &u ) noexcept {
+					return Update{network_byte_order( u.x ), network_byte_order( u.y ), network_byte_order( u.width ),
+					              network_byte_order( u.height )};
+				}
+
 				template<typename T, typename U>
 				static void append( T &destination, U const &source ) {
 					std::copy( source.begin( ), source.end( ), std::back_inserter( destination ) );
@@ -118,205 +266,905 @@ namespace daw {
 					return value != 0;
 				}
 
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: append the framebuffer pixels in [first, last) as 32bpp
+				/// pixels with each channel in the byte the client asked for
+				template<typename Iterator, typename Container>
+				void append_translated( Iterator first, Iterator last, size_t bpp, ClientFormat const &format,
+				                        std::array<Colour, 256> const &palette, Container &destination ) {
+					auto const count = static_cast<size_t>( std::distance( first, last ) ) / bpp;
+					auto const pos = destination.size( );
+					destination.resize( pos + ( count * sizeof( Colour ) ) );
+					auto out = destination.begin( ) + static_cast<std::ptrdiff_t>( pos );
+					for( size_t n = 0; n < count; ++n, first += bpp, out += sizeof( Colour ) ) {
+						Colour colour{};
+						switch( bpp ) {
+						case 1:
+							colour = palette[first[0]];
+							break;
+						case 2: {
+							// 16bpp pixels are little endian 565, widen each channel to 8 bits
+							auto const value = static_cast<uint16_t>( first[0] | ( first[1] << 8 ) );
+							auto const red = static_cast<uint8_t>( ( value >> 11 ) & 0x1F );
+							auto const green = static_cast<uint8_t>( ( value >> 5 ) & 0x3F );
+							auto const blue = static_cast<uint8_t>( value & 0x1F );
+							colour.red = static_cast<uint8_t>( ( red << 3 ) | ( red >> 2 ) );
+							colour.green = static_cast<uint8_t>( ( green << 2 ) | ( green >> 4 ) );
+							colour.blue = static_cast<uint8_t>( ( blue << 3 ) | ( blue >> 2 ) );
+						} break;
+						default:
+							colour = Colour{first[0], first[1], first[2], 0};
+							break;
+						}
+						out[0] = out[1] = out[2] = out[3] = 0;
+						out[format.red_byte] = static_cast<typename Container::value_type>( colour.red );
+						out[format.green_byte] = static_cast<typename Container::value_type>( colour.green );
+						out[format.blue_byte] = static_cast<typename Container::value_type>( colour.blue );
+					}
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: work out how to send pixels to a client that asked for
+				/// pixel_format.  Colour mapped clients of a 32bpp framebuffer get
+				/// palette indices and 32bpp true colour clients get each channel in
+				/// the byte they asked for.  Returns false for formats that are not
+				/// supported
+				bool get_client_format( ServerInitialisationMsg::pixel_format_t const &pixel_format, uint8_t bit_depth,
+				                        ClientFormat &format ) {
+					format.colour_mapped = false;
+					format.translated = false;
+					format.red_byte = format.green_byte = format.blue_byte = 0;
+					if( !as_bool( pixel_format.true_colour_flag ) ) {
+						if( pixel_format.bpp != 8 || bit_depth == 16 ) {
+							return false;
+						}
+						format.colour_mapped = bit_depth == 32;
+						return true;
+					}
+					auto const native = create_server_initialization_message( 0, 0, bit_depth ).pixel_format;
+					if( bit_depth == 16 && pixel_format.bpp == 16 &&
+					    pixel_format.big_endian_flag == native.big_endian_flag &&
+					    pixel_format.red_max == native.red_max && pixel_format.green_max == native.green_max &&
+					    pixel_format.blue_max == native.blue_max && pixel_format.red_shift == native.red_shift &&
+					    pixel_format.green_shift == native.green_shift &&
+					    pixel_format.blue_shift == native.blue_shift ) {
+						return true;
+					}
+					if( pixel_format.bpp != 32 || pixel_format.red_max != 255 || pixel_format.green_max != 255 ||
+					    pixel_format.blue_max != 255 ) {
+						return false;
+					}
+					auto const valid_shift = []( uint8_t shift ) { return shift % 8 == 0 && shift <= 24; };
+					if( !valid_shift( pixel_format.red_shift ) || !valid_shift( pixel_format.green_shift ) ||
+					    !valid_shift( pixel_format.blue_shift ) || pixel_format.red_shift == pixel_format.green_shift ||
+					    pixel_format.red_shift == pixel_format.blue_shift ||
+					    pixel_format.green_shift == pixel_format.blue_shift ) {
+						return false;
+					}
+					auto const big_endian = as_bool( pixel_format.big_endian_flag );
+					auto const to_byte = [big_endian]( uint8_t shift ) {
+						return static_cast<uint8_t>( big_endian ? 3 - ( shift / 8 ) : shift / 8 );
+					};
+					format.red_byte = to_byte( pixel_format.red_shift );
+					format.green_byte = to_byte( pixel_format.green_shift );
+					format.blue_byte = to_byte( pixel_format.blue_shift );
+					// A 32bpp framebuffer is stored red, green, blue so that layout is sent as it is
+					format.translated =
+					    bit_depth != 32 || format.red_byte != 0 || format.green_byte != 1 || format.blue_byte != 2;
+					if( !format.translated ) {
+						format.red_byte = format.green_byte = format.blue_byte = 0;
+					}
+					return true;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: reduce the scale x scale blocks of pixels starting at source
+				/// to a row of width pixels.  32bpp pixels are box filtered per channel,
+				/// first summing the rows of the blocks byte for byte and then summing
+				/// the columns of each block.  Both loops are unit stride so that they
+				/// vectorise.  Palette indices and packed 16bpp pixels cannot be
+				/// averaged byte by byte, so the top left pixel of each block is used
+				/// for them
+				void scale_row( uint8_t const *source, size_t stride, size_t scale, size_t width, size_t bpp,
+				                std::vector<uint32_t> &sums, std::vector<uint8_t> &destination ) {
+					destination.resize( width * bpp );
+					if( bpp != sizeof( Colour ) ) {
+						for( size_t x = 0; x < width; ++x ) {
+							std::copy( source + ( x * scale * bpp ), source + ( x * scale * bpp ) + bpp,
+							           destination.begin( ) + static_cast<std::ptrdiff_t>( x * bpp ) );
+						}
+						return;
+					}
+					auto const row_size = width * scale * sizeof( Colour );
+					sums.assign( row_size, 0 );
+					auto const column_sums = sums.data( );
+					for( size_t y = 0; y < scale; ++y ) {
+						auto const row = source + ( y * stride );
+						for( size_t n = 0; n < row_size; ++n ) {
+							column_sums[n] += row[n];
+						}
+					}
+					auto const area = static_cast<uint32_t>( scale * scale );
+					for( size_t x = 0; x < width; ++x ) {
+						auto const block = column_sums + ( x * scale * sizeof( Colour ) );
+						std::array<uint32_t, sizeof( Colour )> totals{};
+						for( size_t n = 0; n < scale; ++n ) {
+							for( size_t channel = 0; channel < sizeof( Colour ); ++channel ) {
+								totals[channel] += block[( n * sizeof( Colour ) ) + channel];
+							}
+						}
+						for( size_t channel = 0; channel < sizeof( Colour ); ++channel ) {
+							destination[( x * sizeof( Colour ) ) + channel] =
+							    static_cast<uint8_t>( totals[channel] / area );
+						}
+					}
+				}
+
+				constexpr uint16_t to_framebuffer_coordinate( uint16_t value, uint8_t scale, uint16_t max ) noexcept {
+					return static_cast<uint16_t>( std::min<size_t>( static_cast<size_t>( value ) * scale, max ) );
+				}
+
+				// Returned when parsing a client message instead of its size
+				constexpr size_t const message_incomplete = 0;
+				constexpr size_t const connection_closed = std::numeric_limits<size_t>::max( );
+
+				constexpr size_t get_bytes_per_pixel( size_t bit_depth ) noexcept {
+					return bit_depth == 8 ? 1 : bit_depth == 16 ? 2 : 4;
+				}
+
 				constexpr size_t get_buffer_size( size_t width, size_t height, size_t bit_depth ) noexcept {
-					return static_cast<size_t>( width * height * ( bit_depth == 8 ? 1 : bit_depth == 16 ? 2 : 4 ) );
+					return static_cast<size_t>( width * height * get_bytes_per_pixel( bit_depth ) );
+				}
+
+				void send_server_version_msg( daw::nodepp::lib::net::NetSocketStream const &socket ) {
+					daw::string_view const rfb_version = "RFB 003.003\n";
+					socket->write( rfb_version );
+				}
+
+				bool recv_client_version_msg( daw::nodepp::lib::net::NetSocketStream const &socket,
+				                              std::shared_ptr<daw::nodepp::base::data_t> data_buffer ) {
+					auto result = validate_fixed_buffer( data_buffer, 12 );
+
+					std::string const expected_msg = "RFB 003.003\n";
+
+					if( !std::equal( expected_msg.begin( ), expected_msg.end( ), data_buffer->begin( ) ) ) {
+						result = false;
+						auto msg = std::make_shared<daw::nodepp::base::data_t>( );
+						append( *msg,
+						        to_bytes( static_cast<uint32_t>( 0 ) ) ); // Authentication Scheme 0, Connection Failed
+						std::string const err_msg = "Unsupported version, only 3.3 is supported";
+						append( *msg, err_msg );
+						socket->write( *msg );
+					}
+					return result;
+				}
+
+				void send_authentication_msg( daw::nodepp::lib::net::NetSocketStream const &socket ) {
+					auto msg = std::make_shared<daw::nodepp::base::data_t>( );
+					append( *msg, to_bytes( static_cast<uint32_t>( 1 ) ) ); // Authentication Scheme 1, No Auth
+					socket->write( *msg );
+				}
+
+				bool recv_client_initialization_msg( std::shared_ptr<daw::nodepp::base::data_t> data_buffer,
+				                                     bool &shared ) {
+					if( validate_fixed_buffer( data_buffer, 1 ) ) {
+						shared = as_bool( ( *data_buffer )[0] );
+						return true;
+					}
+					return false;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: exchange versions, authenticate and receive the client
+				/// initialisation message.  on_initialised( socket, shared ) is called
+				/// once the client is ready for the server initialisation message
+				template<typename OnInitialised>
+				void perform_handshake( daw::nodepp::lib::net::NetSocketStream socket, OnInitialised on_initialised ) {
+					// We have sent the server version, now validate client version
+					socket->on_next_data_received( [socket, on_initialised](
+					                                   std::shared_ptr<daw::nodepp::base::data_t> buffer1, bool ) mutable {
+						if( !recv_client_version_msg( socket, buffer1 ) ) {
+							socket->close( );
+							return;
+						}
+
+						// Authentication message is sent
+						socket->on_next_data_received( [socket, on_initialised](
+						                                   std::shared_ptr<daw::nodepp::base::data_t> buffer2, bool ) mutable {
+							// Client Initialization Message expected, data buffer should have 1 value
+							bool shared = false;
+							if( !recv_client_initialization_msg( buffer2, shared ) ) {
+								socket->close( );
+								return;
+							}
+							on_initialised( socket, shared );
+						} );
+						send_authentication_msg( socket );
+						socket->read_async( );
+					} );
+					send_server_version_msg( socket );
+					socket->read_async( );
 				}
 			} // namespace
 
-			class RFBServerImpl final {
+			//////////////////////////////////////////////////////////////////////////
+			/// Summary: recycles message buffers so that their capacity is reused
+			/// instead of being allocated for every message.  Buffers handed out
+			/// return themselves to the pool when the last reference is released
+			class BufferPool final : public std::enable_shared_from_this<BufferPool> {
+				std::mutex m_mutex;
+				std::vector<std::unique_ptr<daw::nodepp::base::data_t>> m_buffers;
+				size_t m_max_buffers;
+				size_t m_max_capacity;
+
+				void release( std::unique_ptr<daw::nodepp::base::data_t> buffer ) {
+					if( buffer->capacity( ) > m_max_capacity ) {
+						return;
+					}
+					std::lock_guard<std::mutex> lock{m_mutex};
+					if( m_buffers.size( ) < m_max_buffers ) {
+						m_buffers.push_back( std::move( buffer ) );
+					}
+				}
+
+			  public:
+				BufferPool( size_t max_buffers, size_t max_capacity )
+				    : m_mutex{}, m_buffers{}, m_max_buffers{max_buffers}, m_max_capacity{max_capacity} {}
+
+				std::shared_ptr<daw::nodepp::base::data_t> acquire( ) {
+					std::unique_ptr<daw::nodepp::base::data_t> buffer;
+					{
+						std::lock_guard<std::mutex> lock{m_mutex};
+						if( !m_buffers.empty( ) ) {
+							buffer = std::move( m_buffers.back( ) );
+							m_buffers.pop_back( );
+						}
+					}
+					if( !buffer ) {
+						buffer = std::make_unique<daw::nodepp::base::data_t>( );
+					}
+					buffer->clear( );
+					std::weak_ptr<BufferPool> pool = shared_from_this( );
+					return std::shared_ptr<daw::nodepp::base::data_t>(
+					    buffer.release( ), [pool]( daw::nodepp::base::data_t *ptr ) {
+						    std::unique_ptr<daw::nodepp::base::data_t> released{ptr};
+						    if( auto self = pool.lock( ) ) {
+							    self->release( std::move( released ) );
+						    }
+					    } );
+				}
+			}; // class BufferPool
+
+			std::shared_ptr<BufferPool> create_buffer_pool( ) {
+				return std::make_shared<BufferPool>( 64, 4 * 1024 * 1024 );
+			}
+
+			class RFBServerImpl final : public std::enable_shared_from_this<RFBServerImpl> {
+				friend class SessionDirectory<RFBServerImpl>;
+
 				uint16_t m_width;
 				uint16_t m_height;
 				uint8_t m_bit_depth;
 				std::vector<uint8_t> m_buffer;
-				std::vector<Update> m_updates;
+				std::mutex m_updates_mutex;
+				std::vector<Update> m_updates; // Areas changed since the last update
+				std::array<Colour, 256> m_palette;
+				daw::nodepp::base::EventEmitter m_emitter;
+				std::shared_ptr<BufferPool> m_buffer_pool;
+				mutable std::mutex m_clients_mutex;
+				ClientRegistry<Client> m_clients;
 				daw::nodepp::lib::net::NetServer m_server;
 				std::thread m_service_thread;
+				std::shared_ptr<SessionRecorder> m_recorder;
+				std::function<uint8_t( std::string const &remote_address, uint16_t remote_port )> m_scale_selector;
+				ClipboardText m_clipboard;
+				std::shared_ptr<daw::nodepp::base::data_t> m_clipboard_provide;
+				std::atomic<size_t> m_max_clipboard_size; // Read while receiving without holding a lock
 
 				void send_all( std::shared_ptr<daw::nodepp::base::data_t> buffer ) {
 					assert( buffer );
-					m_server->emitter( )->emit( "send_buffer", buffer );
+					record( RecordDirection::server_to_client, *buffer );
+					write_all( *buffer );
 				}
 
-				bool recv_client_initialization_msg( daw::nodepp::lib::net::NetSocketStream &socket,
-				                                     std::shared_ptr<daw::nodepp::base::data_t> data_buffer,
-				                                     int64_t callback_id ) {
-					if( validate_fixed_buffer( data_buffer, 1 ) ) {
-						if( !as_bool( ( *data_buffer )[0] ) ) {
-							this->m_server->emitter( )->emit( "close_all", callback_id );
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: send to every client without recording
+				void write_all( daw::nodepp::base::data_t const &buffer ) {
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					m_clients.for_each( [&buffer]( Client &client ) { client.socket->write( buffer ); } );
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: close every client but the one specified.  This is used when
+				/// a client connects and requests that no other clients share the session
+				void close_all_except( ClientId id ) {
+					std::vector<daw::nodepp::lib::net::NetSocketStream> sockets;
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						sockets.reserve( m_clients.size( ) );
+						m_clients.for_each_except(
+						    id, [&sockets]( Client &client ) { sockets.push_back( client.socket ); } );
+					}
+					// Closing removes the client from the registry so it cannot be done while iterating it
+					for( auto &socket : sockets ) {
+						socket->close( );
+					}
+				}
+
+				size_t client_count( ) const {
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					return m_clients.size( );
+				}
+
+				void record( RecordDirection::values direction, daw::nodepp::base::data_t const &buffer ) {
+					auto recorder = std::atomic_load( &m_recorder );
+					if( !recorder ) {
+						return;
+					}
+					if( direction == RecordDirection::server_to_client && recorder->keyframe_due( ) ) {
+						recorder->append( RecordDirection::keyframe, m_buffer.data( ), m_buffer.size( ) );
+					}
+					recorder->append( direction, reinterpret_cast<uint8_t const *>( buffer.data( ) ), buffer.size( ) );
+				}
+
+				void attach_client( daw::nodepp::lib::net::NetSocketStream socket, bool shared ) {
+					auto const scale = select_scale( socket );
+					ClientId id;
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						id = m_clients.add( Client{socket, ClientFormat{scale, false, false, 0, 0, 0}, false,
+						                           ExtendedClipboard::default_client_caps,
+						                           ExtendedClipboard::default_client_text_size, CutTextTransfer{},
+						                           daw::nodepp::base::data_t{}} );
+					}
+
+					// When socket is closed, remove it from the clients.  The session may have been removed from a
+					// host before the socket closes so only a weak reference is held
+					std::weak_ptr<RFBServerImpl> weak_self = shared_from_this( );
+					socket->emitter( )->on( "close", [weak_self, id]( ) {
+						if( auto self = weak_self.lock( ) ) {
+							self->detach_client( id );
 						}
-						return true;
+					} );
+
+					if( !shared ) {
+						close_all_except( id );
 					}
-					return false;
+
+					// Server Initialization Sent, main reception loop
+					socket->on_data_received(
+					    [socket, weak_self, id]( std::shared_ptr<daw::nodepp::base::data_t> buffer, bool ) mutable {
+						    // Main Receive Loop
+						    if( auto self = weak_self.lock( ) ) {
+							    self->parse_client_msg( socket, id, buffer );
+						    } else {
+							    socket->close( );
+						    }
+					    } );
+					send_server_initialization_msg( socket, scale );
+					if( m_bit_depth == 8 ) {
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						socket->write( *create_colour_map_message( 0, static_cast<uint16_t>( m_palette.size( ) ) ) );
+					}
+					socket->read_async( );
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: the scale is fixed at connection as the reduced size is sent
+				/// in the server initialisation message.  It is limited so that the
+				/// client's view is at least one pixel in each direction
+				uint8_t select_scale( daw::nodepp::lib::net::NetSocketStream const &socket ) const {
+					decltype( m_scale_selector ) selector;
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						selector = m_scale_selector;
+					}
+					if( !selector ) {
+						return 1;
+					}
+					auto const scale = selector( socket->remote_address( ), socket->remote_port( ) );
+					auto const max_scale = std::min<size_t>( std::min( m_width, m_height ), 255 );
+					return static_cast<uint8_t>( std::max<size_t>( 1, std::min<size_t>( scale, max_scale ) ) );
+				}
+
+				bool client_extended_clipboard( ClientId id ) const {
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					auto client = m_clients.find( id );
+					return client && client->extended_clipboard;
+				}
+
+				ClientFormat client_format( ClientId id ) const {
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					auto client = m_clients.find( id );
+					if( !client ) {
+						return ClientFormat{1, false, false, 0, 0, 0};
+					}
+					return client->format;
+				}
+
+				void detach_client( ClientId id ) {
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						m_clients.remove( id );
+						if( !m_clients.empty( ) ) {
+							return;
+						}
+						// Nobody is watching, give back memory that is only needed while sending
+						m_clients.shrink_to_fit( );
+					}
+					std::lock_guard<std::mutex> lock{m_updates_mutex};
+					m_updates.clear( );
+					m_updates.shrink_to_fit( );
 				}
 
 				void setup_callbacks( ) {
-					m_server->on_connection( [&, &srv = m_server ]( auto socket ) {
+					m_server->on_connection( [this]( auto socket ) {
 						std::cout << "Connection from: " << socket->remote_address( ) << ":" << socket->remote_port( )
 						          << std::endl;
-						// Setup send_buffer callback on server.  This is registered by all sockets so that updated
-						// areas can be sent to all clients
-						auto send_buffer_callback_id = srv->emitter( )->add_listener(
-						    "send_buffer", [s = socket]( std::shared_ptr<daw::nodepp::base::data_t> buffer ) mutable {
-							    s->write( buffer->data( ) );
-						    } );
-
-						// TODO:****************DAW**********HERE***********
-						// The close_all callback will close all vnc sessions but the one specified.  This is used when
-						// a client connects and requests that no other clients share the session
-						auto close_all_callback_id = srv->emitter( )->add_listener(
-						    "close_all", [ test_callback_id = send_buffer_callback_id,
-							               socket ]( int64_t current_callback_id ) mutable {
-							    if( test_callback_id != current_callback_id ) {
-								    socket->close( );
-							    }
-						    } );
-
-						// When socket is closed, remove registered callbacks in server
-						socket->emitter( )->on( "close", [&srv, send_buffer_callback_id, close_all_callback_id]( ) {
-							srv->emitter( )->remove_listener( "send_buffer", send_buffer_callback_id );
-							srv->emitter( )->remove_listener( "close_all", close_all_callback_id );
+						std::weak_ptr<RFBServerImpl> weak_self = this->shared_from_this( );
+						perform_handshake( socket, [weak_self]( auto s, bool shared ) {
+							if( auto self = weak_self.lock( ) ) {
+								self->attach_client( s, shared );
+							} else {
+								s->close( );
+							}
 						} );
-
-						// We have sent the server version, now validate client version
-						socket->on_next_data_received(
-						    [this, socket, send_buffer_callback_id]( std::shared_ptr<daw::nodepp::base::data_t> buffer1,
-						                                             bool ) mutable {
-							    if( !this->revc_client_version_msg( socket, buffer1 ) ) {
-								    socket->close( );
-								    return;
-							    }
-
-							    // Authentication message is sent
-							    socket->on_next_data_received(
-							        [socket, this, send_buffer_callback_id](
-							            std::shared_ptr<daw::nodepp::base::data_t> buffer2, bool ) mutable {
-								        // Client Initialization Message expected, data buffer should have 1 value
-								        if( !this->recv_client_initialization_msg( socket, buffer2,
-								                                                   send_buffer_callback_id ) ) {
-									        socket->close( );
-									        return;
-								        }
-
-								        // Server Initialization Sent, main reception loop
-								        socket->on_data_received(
-								            [socket, this](
-								                std::shared_ptr<daw::nodepp::base::data_t> buffer3, bool ) mutable {
-									            // Main Receive Loop
-									            this->parse_client_msg( socket, buffer3 );
-									            return;
-									            socket->read_async( );
-								            } );
-								        this->send_server_initialization_msg( socket );
-								        socket->read_async( );
-							        } );
-							    this->send_authentication_msg( socket );
-							    socket->read_async( );
-						    } );
-						this->send_server_version_msg( socket );
-						socket->read_async( );
 					} );
 				}
 
-				void parse_client_msg( daw::nodepp::lib::net::NetSocketStream const &socket,
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: build a SetColourMapEntries message from the palette.  The
+				/// caller must hold m_clients_mutex
+				std::shared_ptr<daw::nodepp::base::data_t>
+				create_colour_map_message( uint16_t first_colour, uint16_t number_of_colours ) const {
+					auto buffer = m_buffer_pool->acquire( );
+					ServerSetColourMapEntriesMsg msg{};
+					msg.message_type = 1;
+					msg.first_colour = network_byte_order( first_colour );
+					msg.number_of_colours = network_byte_order( number_of_colours );
+					append( *buffer, to_bytes( msg ) );
+					auto const append_value = [&buffer]( uint8_t value ) {
+						// Colour map values are 16 bit, scale so that 255 maps to 65535
+						append( *buffer, to_bytes( network_byte_order( static_cast<uint16_t>( value * 257 ) ) ) );
+					};
+					for( size_t n = first_colour; n < first_colour + number_of_colours; ++n ) {
+						append_value( m_palette[n].red );
+						append_value( m_palette[n].green );
+						append_value( m_palette[n].blue );
+					}
+					return buffer;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: change the pixels sent to a client, returns false when the
+				/// pixel format is not supported
+				bool set_client_pixel_format( ClientId id, ServerInitialisationMsg::pixel_format_t pixel_format ) {
+					pixel_format.red_max = network_byte_order( pixel_format.red_max );
+					pixel_format.green_max = network_byte_order( pixel_format.green_max );
+					pixel_format.blue_max = network_byte_order( pixel_format.blue_max );
+
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					auto client = m_clients.find( id );
+					if( !client ) {
+						return true;
+					}
+					auto format = client->format;
+					if( !get_client_format( pixel_format, m_bit_depth, format ) ) {
+						return false;
+					}
+					if( format.colour_mapped && !client->format.colour_mapped ) {
+						auto const number_of_colours = static_cast<uint16_t>( m_palette.size( ) );
+						client->socket->write( *create_colour_map_message( 0, number_of_colours ) );
+					}
+					client->format = format;
+					return true;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: build a ServerCutText message in the Extended Clipboard
+				/// format, a negative length followed by the flags and payload.  The
+				/// length and flags are in network byte order
+				std::shared_ptr<daw::nodepp::base::data_t>
+				create_extended_clipboard_message( uint32_t flags, char const *payload, size_t size ) const {
+					auto buffer = m_buffer_pool->acquire( );
+					buffer->push_back( 3 ); // Message Type, ServerCutText
+					buffer->push_back( 0 ); // Padding
+					buffer->push_back( 0 ); // Padding
+					buffer->push_back( 0 ); // Padding
+					auto const length = -static_cast<int32_t>( sizeof( flags ) + size );
+					append( *buffer, to_bytes( network_byte_order( length ) ) );
+					append( *buffer, to_bytes( network_byte_order( flags ) ) );
+					buffer->insert( buffer->end( ), payload, payload + size );
+					return buffer;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: the clipboard text, compressed once and only when a client
+				/// asks for it.  The caller must not hold m_clients_mutex, the text is
+				/// copied under it but compressed without it
+				std::shared_ptr<daw::nodepp::base::data_t> get_clipboard_provide_message( ) {
+					// Each format is a length followed by the data, text is null terminated
+					std::string payload;
+					uint64_t version = 0;
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						if( m_clipboard_provide ) {
+							return m_clipboard_provide;
+						}
+						auto const &text = m_clipboard.text( );
+						payload.reserve( sizeof( uint32_t ) + text.size( ) + 1 );
+						auto const size = static_cast<uint32_t>( text.size( ) + 1 );
+						append( payload, to_bytes( network_byte_order( size ) ) );
+						payload += text;
+						payload.push_back( 0 );
+						version = m_clipboard.version( );
+					}
+					auto const compressed = zlib_compress( payload.data( ), payload.size( ) );
+					auto message = create_extended_clipboard_message(
+					    ExtendedClipboard::provide | ExtendedClipboard::text, compressed.data( ), compressed.size( ) );
+
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					// The text may have changed while compressing, that message is not kept
+					if( m_clipboard.version( ) == version ) {
+						m_clipboard_provide = message;
+					}
+					return message;
+				}
+
+				void set_client_encodings( ClientId id, std::vector<int32_t> const &encodings ) {
+					auto const extended_clipboard =
+					    std::find( encodings.begin( ), encodings.end( ), ExtendedClipboard::pseudo_encoding ) !=
+					    encodings.end( );
+
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					auto client = m_clients.find( id );
+					if( !client ) {
+						return;
+					}
+					if( extended_clipboard && !client->extended_clipboard ) {
+						auto const max_size =
+						    to_bytes( network_byte_order( ExtendedClipboard::max_unsolicited_text_size ) );
+						client->socket->write( *create_extended_clipboard_message(
+						    ExtendedClipboard::caps | ExtendedClipboard::request | ExtendedClipboard::peek |
+						        ExtendedClipboard::notify | ExtendedClipboard::provide | ExtendedClipboard::text,
+						    reinterpret_cast<char const *>( max_size.data( ) ), max_size.size( ) ) );
+					}
+					client->extended_clipboard = extended_clipboard;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: add data to the client's ClientCutText transfer and return
+				/// how much of it was used.  A completed transfer is handled here
+				size_t continue_cut_text( daw::nodepp::lib::net::NetSocketStream const &socket, ClientId id,
+				                          char const *data, size_t size ) {
+					CutTextTransfer completed{};
+					size_t consumed = 0;
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						auto client = m_clients.find( id );
+						if( !client || client->cut_text.complete( ) ) {
+							return 0;
+						}
+						consumed = client->cut_text.add( data, size );
+						if( !client->cut_text.complete( ) ) {
+							return consumed;
+						}
+						std::swap( completed, client->cut_text );
+					}
+					if( !completed.discard ) {
+						finish_cut_text( socket, id, completed );
+					}
+					return consumed;
+				}
+
+				void begin_cut_text( daw::nodepp::lib::net::NetSocketStream const &socket, ClientId id, bool extended,
+				                     size_t size, char const *data, size_t available ) {
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						auto client = m_clients.find( id );
+						if( !client ) {
+							return;
+						}
+						client->cut_text = CutTextTransfer{size, extended, m_max_clipboard_size.load( )};
+					}
+					if( size == 0 ) {
+						finish_cut_text( socket, id, CutTextTransfer{0, extended, 0} );
+						return;
+					}
+					continue_cut_text( socket, id, data, available );
+				}
+
+				void finish_cut_text( daw::nodepp::lib::net::NetSocketStream const &socket, ClientId id,
+				                      CutTextTransfer const &transfer ) {
+					if( !transfer.extended ) {
+						emit_client_clipboard_text( daw::string_view{transfer.data.data( ), transfer.data.size( )} );
+						return;
+					}
+					if( transfer.data.size( ) < sizeof( uint32_t ) ) {
+						return;
+					}
+					uint32_t flags = 0;
+					std::copy( transfer.data.begin( ), transfer.data.begin( ) + sizeof( flags ),
+					           reinterpret_cast<char *>( &flags ) );
+					flags = network_byte_order( flags );
+					auto const has_text = ( flags & ExtendedClipboard::text ) != 0;
+
+					if( flags & ExtendedClipboard::caps ) {
+						// The flags are followed by the largest size of each format, text is the first
+						uint32_t max_text_size = 0;
+						if( has_text && transfer.data.size( ) >= sizeof( flags ) + sizeof( max_text_size ) ) {
+							std::copy( transfer.data.begin( ) + sizeof( flags ),
+							           transfer.data.begin( ) + sizeof( flags ) + sizeof( max_text_size ),
+							           reinterpret_cast<char *>( &max_text_size ) );
+							max_text_size = network_byte_order( max_text_size );
+						}
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						auto client = m_clients.find( id );
+						if( client ) {
+							client->clipboard_caps = flags;
+							client->max_text_size = max_text_size;
+						}
+						return;
+					}
+					if( flags & ExtendedClipboard::peek ) {
+						uint32_t formats = 0;
+						{
+							std::lock_guard<std::mutex> lock{m_clients_mutex};
+							if( !m_clients.find( id ) ) {
+								return;
+							}
+							formats = m_clipboard.has_text( ) ? ExtendedClipboard::text : 0u;
+						}
+						socket->write(
+						    *create_extended_clipboard_message( ExtendedClipboard::notify | formats, nullptr, 0 ) );
+						return;
+					}
+					if( flags & ExtendedClipboard::request ) {
+						if( has_text && client_extended_clipboard( id ) ) {
+							socket->write( *get_clipboard_provide_message( ) );
+						}
+						return;
+					}
+					if( ( flags & ExtendedClipboard::notify ) && has_text ) {
+						// Ask for the text now that we know there is some
+						socket->write( *create_extended_clipboard_message(
+						    ExtendedClipboard::request | ExtendedClipboard::text, nullptr, 0 ) );
+						return;
+					}
+					if( ( flags & ExtendedClipboard::provide ) && has_text ) {
+						std::string payload;
+						if( !zlib_decompress( transfer.data.data( ) + sizeof( flags ),
+						                      transfer.data.size( ) - sizeof( flags ),
+						                      m_max_clipboard_size.load( ) + sizeof( uint32_t ), payload ) ||
+						    payload.size( ) < sizeof( uint32_t ) ) {
+							return;
+						}
+						uint32_t size = 0;
+						std::copy( payload.begin( ), payload.begin( ) + sizeof( size ),
+						           reinterpret_cast<char *>( &size ) );
+						size = network_byte_order( size );
+						size = std::min<uint32_t>( size, static_cast<uint32_t>( payload.size( ) - sizeof( size ) ) );
+						daw::string_view text{payload.data( ) + sizeof( size ), size};
+						// Text is null terminated
+						while( !text.empty( ) && text.data( )[text.size( ) - 1] == 0 ) {
+							text = daw::string_view{text.data( ), text.size( ) - 1};
+						}
+						emit_client_clipboard_text( text );
+					}
+				}
+
+				void parse_client_msg( daw::nodepp::lib::net::NetSocketStream const &socket, ClientId id,
 				                       std::shared_ptr<daw::nodepp::base::data_t> const &buffer ) {
-					if( !buffer && buffer->empty( ) ) {
+					if( !buffer || buffer->empty( ) ) {
 						socket->close( );
 						return;
 					}
-					auto const &message_type = buffer->front( );
+					record( RecordDirection::client_to_server, *buffer );
+					// The data may continue a ClientCutText that did not fit in earlier reads
+					auto const pos = continue_cut_text( socket, id, buffer->data( ), buffer->size( ) );
+					// Or complete a message whose start was at the end of the last read
+					auto pending = take_pending_data( id );
+					if( pending.empty( ) ) {
+						parse_client_msgs( socket, id, *buffer, pos );
+						return;
+					}
+					pending.insert( pending.end( ), buffer->begin( ) + static_cast<std::ptrdiff_t>( pos ),
+					                buffer->end( ) );
+					parse_client_msgs( socket, id, pending, 0 );
+				}
+
+				daw::nodepp::base::data_t take_pending_data( ClientId id ) {
+					daw::nodepp::base::data_t result;
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					auto client = m_clients.find( id );
+					if( client ) {
+						std::swap( result, client->pending );
+					}
+					return result;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: a read can hold many messages, they are handled in place one
+				/// after the other.  A message cut off by the end of the read is kept
+				/// until the next read arrives
+				void parse_client_msgs( daw::nodepp::lib::net::NetSocketStream const &socket, ClientId id,
+				                        daw::nodepp::base::data_t const &buffer, size_t pos ) {
+					while( pos < buffer.size( ) ) {
+						auto const size = dispatch_client_msg( socket, id, buffer, pos );
+						if( size == connection_closed ) {
+							return;
+						}
+						if( size == message_incomplete ) {
+							std::lock_guard<std::mutex> lock{m_clients_mutex};
+							auto client = m_clients.find( id );
+							if( client ) {
+								client->pending.assign( buffer.begin( ) + static_cast<std::ptrdiff_t>( pos ),
+								                        buffer.end( ) );
+							}
+							return;
+						}
+						pos += size;
+					}
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: handle the message starting at pos and return its size.  When
+				/// the message is not all there message_incomplete is returned and nothing
+				/// is done, connection_closed is returned when the socket was closed
+				size_t dispatch_client_msg( daw::nodepp::lib::net::NetSocketStream const &socket, ClientId id,
+				                            daw::nodepp::base::data_t const &buffer, size_t pos ) {
+					auto const available = buffer.size( ) - pos;
+					auto const &message_type = buffer[pos];
 					switch( message_type ) {
-					case 0: // SetPixelFormat
-						break;
-					case 1: // FixColourMapEntries
-						break;
-					case 2: // SetEncodings
-						break;
-					case 3: { // FramebufferUpdateRequest
-						if( buffer->size( ) < sizeof( ClientFrameBufferUpdateRequestMsg ) ) {
+					case 0: { // SetPixelFormat
+						if( available < sizeof( ClientSetPixelFormatMsg ) ) {
+							return message_incomplete;
+						}
+						auto req = nodepp::base::from_data_t_to_value<ClientSetPixelFormatMsg>( buffer, pos );
+						if( !set_client_pixel_format( id, req.pixel_format ) ) {
 							socket->close( );
+							return connection_closed;
+						}
+						return sizeof( ClientSetPixelFormatMsg );
+					}
+					case 1: { // FixColourMapEntries
+						if( available < 6 ) {
+							return message_incomplete;
+						}
+						auto const count =
+						    network_byte_order( nodepp::base::from_data_t_to_value<uint16_t>( buffer, pos + 4 ) );
+						auto const size = 6 + ( count * 3 * sizeof( uint16_t ) );
+						if( available < size ) {
+							return message_incomplete;
+						}
+						return size;
+					}
+					case 2: { // SetEncodings
+						if( available < 4 ) {
+							return message_incomplete;
+						}
+						auto const count =
+						    network_byte_order( nodepp::base::from_data_t_to_value<uint16_t>( buffer, pos + 2 ) );
+						auto const size = 4 + ( count * sizeof( int32_t ) );
+						if( available < size ) {
+							return message_incomplete;
+						}
+						std::vector<int32_t> encodings;
+						encodings.reserve( count );
+						for( size_t n = 0; n < count; ++n ) {
+							encodings.push_back( network_byte_order( nodepp::base::from_data_t_to_value<int32_t>(
+							    buffer, pos + 4 + ( n * sizeof( int32_t ) ) ) ) );
+						}
+						set_client_encodings( id, encodings );
+						return size;
+					}
+					case 3: { // FramebufferUpdateRequest
+						if( available < sizeof( ClientFrameBufferUpdateRequestMsg ) ) {
+							return message_incomplete;
 						}
 						auto req =
-						    daw::nodepp::base::from_data_t_to_value<ClientFrameBufferUpdateRequestMsg>( *buffer );
-						add_update_request( req.x, req.y, req.width, req.height );
+						    daw::nodepp::base::from_data_t_to_value<ClientFrameBufferUpdateRequestMsg>( buffer, pos );
+						// Scaled clients ask for areas of their reduced view
+						auto const scale = client_format( id ).scale;
+						auto const x = to_framebuffer_coordinate( network_byte_order( req.x ), scale, m_width );
+						auto const y = to_framebuffer_coordinate( network_byte_order( req.y ), scale, m_height );
+						add_update_request(
+						    x, y, to_framebuffer_coordinate( network_byte_order( req.width ), scale, m_width ),
+						    to_framebuffer_coordinate( network_byte_order( req.height ), scale, m_height ) );
 						update( );
-					} break;
+						return sizeof( ClientFrameBufferUpdateRequestMsg );
+					}
 					case 4: { // KeyEvent
-						if( buffer->size( ) < sizeof( ClientKeyEventMsg ) ) {
-							socket->close( );
+						if( available < sizeof( ClientKeyEventMsg ) ) {
+							return message_incomplete;
 						}
-						auto req = nodepp::base::from_data_t_to_value<ClientKeyEventMsg>( *buffer );
-						emit_key_event( as_bool( req.down_flag ), req.key );
-					} break;
+						auto req = nodepp::base::from_data_t_to_value<ClientKeyEventMsg>( buffer, pos );
+						emit_key_event( as_bool( req.down_flag ), network_byte_order( req.key ) );
+						return sizeof( ClientKeyEventMsg );
+					}
 					case 5: { // PointerEvent
-						if( buffer->size( ) < sizeof( ClientPointerEventMsg ) ) {
-							socket->close( );
+						if( available < sizeof( ClientPointerEventMsg ) ) {
+							return message_incomplete;
 						}
-						auto req = nodepp::base::from_data_t_to_value<ClientPointerEventMsg>( *buffer );
-						emit_pointer_event( create_button_mask( req.button_mask ), req.x, req.y );
-					} break;
+						auto req = nodepp::base::from_data_t_to_value<ClientPointerEventMsg>( buffer, pos );
+						auto const scale = client_format( id ).scale;
+						auto const max_x = static_cast<uint16_t>( m_width - 1 );
+						auto const max_y = static_cast<uint16_t>( m_height - 1 );
+						emit_pointer_event( create_button_mask( req.button_mask ),
+						                    to_framebuffer_coordinate( network_byte_order( req.x ), scale, max_x ),
+						                    to_framebuffer_coordinate( network_byte_order( req.y ), scale, max_y ) );
+						return sizeof( ClientPointerEventMsg );
+					}
 					case 6: { // ClientCutText
-						if( buffer->size( ) < 8 ) {
-							socket->close( );
+						if( available < 8 ) {
+							return message_incomplete;
 						}
-						auto len = nodepp::base::from_data_t_to_value<uint32_t>( *buffer, 4 );
-						// auto len = *(reinterpret_cast<uint32_t *>(buffer->data( ) + 4));
-						if( buffer->size( ) < 8 + len ) {
-							// Verify buffer is long enough and we don't overflow
+						auto const len =
+						    network_byte_order( nodepp::base::from_data_t_to_value<uint32_t>( buffer, pos + 4 ) );
+						// A negative length is an Extended Clipboard message of -length bytes
+						auto const extended = static_cast<int32_t>( len ) < 0;
+						if( extended && !client_extended_clipboard( id ) ) {
+							// Without the pseudo-encoding the length is nonsense and the stream cannot be followed
 							socket->close( );
+							return connection_closed;
 						}
-						daw::string_view text{buffer->data( ) + 8, len};
-						emit_client_clipboard_text( text );
-					} break;
+						size_t const size = extended ? static_cast<size_t>( -static_cast<int64_t>(
+						                                   static_cast<int32_t>( len ) ) )
+						                             : static_cast<size_t>( len );
+						// Large text arrives over several reads and is reassembled before it is handled
+						auto const received = std::min( available - 8, size );
+						begin_cut_text( socket, id, extended, size, buffer.data( ) + pos + 8, received );
+						return 8 + received;
 					}
-				}
-
-				void send_server_version_msg( daw::nodepp::lib::net::NetSocketStream const &socket ) {
-					daw::string_view const rfb_version = "RFB 003.003\n";
-					socket->write( rfb_version );
-				}
-
-				bool revc_client_version_msg( daw::nodepp::lib::net::NetSocketStream const &socket,
-				                              std::shared_ptr<daw::nodepp::base::data_t> data_buffer ) {
-					auto result = validate_fixed_buffer( data_buffer, 12 );
-
-					std::string const expected_msg = "RFB 003.003\n";
-
-					if( !std::equal( expected_msg.begin( ), expected_msg.end( ), data_buffer->begin( ) ) ) {
-						result = false;
-						auto msg = std::make_shared<daw::nodepp::base::data_t>( );
-						append( *msg,
-						        to_bytes( static_cast<uint32_t>( 0 ) ) ); // Authentication Scheme 0, Connection Failed
-						std::string const err_msg = "Unsupported version, only 3.3 is supported";
-						append( *msg, err_msg );
-						socket->write( *msg );
+					default:
+						// The size of an unknown message is unknown so the rest of the stream cannot be read
+						socket->close( );
+						return connection_closed;
 					}
-					return result;
 				}
 
-				void send_server_initialization_msg( daw::nodepp::lib::net::NetSocketStream const &socket ) {
+				void send_server_initialization_msg( daw::nodepp::lib::net::NetSocketStream const &socket,
+				                                     uint8_t scale ) {
+					auto const width = static_cast<uint16_t>( m_width / scale );
+					auto const height = static_cast<uint16_t>( m_height / scale );
+					auto init = create_server_initialization_message( width, height, m_bit_depth );
+					// The message is built in host order, the multi-byte fields are sent in network byte order
+					init.width = network_byte_order( init.width );
+					init.height = network_byte_order( init.height );
+					init.pixel_format.red_max = network_byte_order( init.pixel_format.red_max );
+					init.pixel_format.green_max = network_byte_order( init.pixel_format.green_max );
+					init.pixel_format.blue_max = network_byte_order( init.pixel_format.blue_max );
+
+					daw::string_view const name = "Test RFB Service";
 					auto msg = std::make_shared<daw::nodepp::base::data_t>( );
-					append( *msg, to_bytes( create_server_initialization_message( m_width, m_height, m_bit_depth ) ) );
-					append( *msg, daw::string_view( "Test RFB Service" ) ); // Add title length and title values
+					append( *msg, to_bytes( init ) );
+					append( *msg, to_bytes( network_byte_order( static_cast<uint32_t>( name.size( ) ) ) ) );
+					msg->insert( msg->end( ), name.begin( ), name.end( ) ); // Add title length and title values
 					socket->write( *msg );                                  // Send msg
 				}
 
-				void send_authentication_msg( daw::nodepp::lib::net::NetSocketStream const &socket ) {
-					auto msg = std::make_shared<daw::nodepp::base::data_t>( );
-					append( *msg, to_bytes( static_cast<uint32_t>( 1 ) ) ); // Authentication Scheme 1, No Auth
-					socket->write( *msg );
-				}
-
 			  public:
 				RFBServerImpl( uint16_t width, uint16_t height, uint8_t bit_depth,
-				               daw::nodepp::base::EventEmitter emitter )
+				               daw::nodepp::base::EventEmitter emitter, std::shared_ptr<BufferPool> buffer_pool )
 				    : m_width{width}
 				    , m_height{height}
 				    , m_bit_depth{bit_depth}
 				    , m_buffer( get_buffer_size( width, height, bit_depth ) )
-				    , m_server{daw::nodepp::lib::net::create_net_server( std::move( emitter ) )} {
+				    , m_updates_mutex{}
+				    , m_updates{}
+				    , m_palette( create_default_palette( ) )
+				    , m_emitter{std::move( emitter )}
+				    , m_buffer_pool{std::move( buffer_pool )}
+				    , m_clients_mutex{}
+				    , m_clients{}
+				    , m_server{}
+				    , m_recorder{}
+				    , m_scale_selector{}
+				    , m_clipboard{}
+				    , m_clipboard_provide{}
+				    , m_max_clipboard_size{16 * 1024 * 1024} {
 
 					std::fill( m_buffer.begin( ), m_buffer.end( ), 0 );
-					setup_callbacks( );
 				}
 
 				uint16_t width( ) const noexcept {
@@ -327,7 +1175,18 @@ namespace daw {
 					return m_height;
 				}
 
+				size_t bytes_per_pixel( ) const noexcept {
+					return get_bytes_per_pixel( m_bit_depth );
+				}
+
 				void add_update_request( uint16_t x, uint16_t y, uint16_t width, uint16_t height ) {
+					// Clients may ask for areas outside of the framebuffer
+					if( x >= m_width || y >= m_height ) {
+						return;
+					}
+					width = std::min( width, static_cast<uint16_t>( m_width - x ) );
+					height = std::min( height, static_cast<uint16_t>( m_height - y ) );
+					std::lock_guard<std::mutex> lock{m_updates_mutex};
 					m_updates.push_back( {x, y, width, height} );
 				}
 
@@ -337,9 +1196,9 @@ namespace daw {
 					Box result;
 					result.reserve( static_cast<size_t>( y2 - y1 ) );
 
-					auto const width = x2 - x1;
+					auto const width = ( x2 - x1 ) * bytes_per_pixel( );
 					for( size_t n = y1; n < y2; ++n ) {
-						auto p1 = m_buffer.data( ) + ( m_width * n ) + x1;
+						auto p1 = m_buffer.data( ) + ( ( m_width * n ) + x1 ) * bytes_per_pixel( );
 						auto rng = daw::range::make_range( p1, p1 + width );
 						result.push_back( rng );
 					}
@@ -353,78 +1212,340 @@ namespace daw {
 					BoxReadOnly result;
 					result.reserve( static_cast<size_t>( y2 - y1 ) );
 
-					auto const width = x2 - x1;
+					auto const width = ( x2 - x1 ) * bytes_per_pixel( );
 					for( size_t n = y1; n < y2; ++n ) {
-						auto p1 = m_buffer.data( ) + ( m_width * n ) + x1;
+						auto p1 = m_buffer.data( ) + ( ( m_width * n ) + x1 ) * bytes_per_pixel( );
 						auto rng = daw::range::make_range<uint8_t const *>( p1, p1 + width );
 						result.push_back( rng );
 					}
 					return result;
 				}
 
-				void update( ) {
-					auto buffer = std::make_shared<daw::nodepp::base::data_t>( );
+				std::shared_ptr<daw::nodepp::base::data_t>
+				create_update_message( ClientFormat format, std::vector<uint8_t> const &framebuffer,
+				                       std::vector<Update> const &areas,
+				                       std::array<Colour, 256> const &palette ) const {
+					size_t const scale = format.scale;
+					auto const bpp = bytes_per_pixel( );
+					auto const stride = m_width * bpp;
+
+					std::vector<Update> updates;
+					updates.reserve( areas.size( ) );
+					for( auto const &u : areas ) {
+						auto const scaled = scale_update( u, scale, m_width / scale, m_height / scale );
+						if( scaled.width > 0 ) {
+							updates.push_back( scaled );
+						}
+					}
+
+					auto buffer = m_buffer_pool->acquire( );
 					buffer->push_back( 0 ); // Message Type, FrameBufferUpdate
 					buffer->push_back( 0 ); // Padding
-					append( *buffer, to_bytes( static_cast<uint16_t>( m_updates.size( ) ) ) );
-					impl::process_all( m_updates, [&]( auto const &u ) {
-						append( *buffer, to_bytes( u ) );
-						buffer->push_back( 0 ); // Encoding type RAW
+					append( *buffer, to_bytes( network_byte_order( static_cast<uint16_t>( updates.size( ) ) ) ) );
+
+					std::vector<uint8_t> scaled_row;
+					std::vector<uint32_t> sums;
+					for( auto const &u : updates ) {
+						append( *buffer, to_bytes( network_byte_order( u ) ) );
+						append( *buffer, to_bytes( static_cast<int32_t>( 0 ) ) ); // Encoding type RAW
 						for( size_t row = u.y; row < u.y + u.height; ++row ) {
-							append( *buffer,
-							        daw::range::make_range( m_buffer.begin( ) + ( u.y * m_width ) + u.x,
-							                                m_buffer.begin( ) + ( ( u.y + u.height ) * m_width ) + u.x +
-							                                    u.width ) );
+							auto first = framebuffer.data( ) + ( row * scale * stride ) + ( u.x * scale * bpp );
+							auto last = first + ( u.width * bpp );
+							if( scale > 1 ) {
+								scale_row( first, stride, scale, u.width, bpp, sums, scaled_row );
+								first = scaled_row.data( );
+								last = first + scaled_row.size( );
+							}
+							if( format.colour_mapped ) {
+								append_quantized( first, last, *buffer );
+							} else if( format.translated ) {
+								append_translated( first, last, bpp, format, palette, *buffer );
+							} else {
+								buffer->insert( buffer->end( ), first, last );
+							}
 						}
-					} );
-					send_all( buffer );
+					}
+					return buffer;
+				}
+
+				//////////////////////////////////////////////////////////////////////////
+				/// Summary: send areas of framebuffer to every client in the format it
+				/// asked for.  One message is built for each format in use
+				void write_updates( std::vector<uint8_t> const &framebuffer, std::vector<Update> const &areas,
+				                    bool record_updates ) {
+					auto const recorded_format = ClientFormat{1, false, false, 0, 0, 0};
+					record_updates = record_updates && std::atomic_load( &m_recorder );
+
+					std::vector<ClientFormat> formats;
+					auto const add_format = [&formats]( ClientFormat format ) {
+						if( std::find( formats.begin( ), formats.end( ), format ) == formats.end( ) ) {
+							formats.push_back( format );
+						}
+					};
+					decltype( m_palette ) palette;
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						palette = m_palette;
+						m_clients.for_each( [&]( Client const &client ) { add_format( client.format ); } );
+					}
+					if( record_updates ) {
+						add_format( recorded_format );
+					}
+
+					// Building the messages is the costly part and is done without holding the lock
+					std::vector<std::pair<ClientFormat, std::shared_ptr<daw::nodepp::base::data_t>>> messages;
+					messages.reserve( formats.size( ) );
+					for( auto const &format : formats ) {
+						messages.emplace_back( format, create_update_message( format, framebuffer, areas, palette ) );
+					}
+					auto get_message = [&]( ClientFormat format ) {
+						auto pos = std::find_if( messages.begin( ), messages.end( ),
+						                         [format]( auto const &m ) { return m.first == format; } );
+						if( pos != messages.end( ) ) {
+							return pos->second;
+						}
+						// The client connected or changed its format while the messages were built
+						messages.emplace_back( format, create_update_message( format, framebuffer, areas, palette ) );
+						return messages.back( ).second;
+					};
+
+					if( record_updates ) {
+						record( RecordDirection::server_to_client, *get_message( recorded_format ) );
+					}
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					m_clients.for_each(
+					    [&]( Client &client ) { client.socket->write( *get_message( client.format ) ); } );
+				}
+
+				void update( ) {
+					// Areas added while sending are left for the next update
+					std::vector<Update> updates;
+					{
+						std::lock_guard<std::mutex> lock{m_updates_mutex};
+						updates.swap( m_updates );
+					}
+					if( client_count( ) == 0 ) {
+						return;
+					}
+					write_updates( m_buffer, updates, true );
+
+					// Keep the memory for the next update unless more areas have come in
+					updates.clear( );
+					std::lock_guard<std::mutex> lock{m_updates_mutex};
+					if( m_updates.empty( ) ) {
+						m_updates.swap( updates );
+					}
+				}
+
+				void set_palette( uint8_t first_colour, std::vector<Colour> const &colours ) {
+					daw::exception::daw_throw_on_false( m_bit_depth == 8, "Only 8bpp framebuffers have a palette" );
+					daw::exception::daw_throw_on_false( first_colour + colours.size( ) <= m_palette.size( ),
+					                                    "Too many colours for palette" );
+					std::shared_ptr<daw::nodepp::base::data_t> buffer;
+					std::vector<daw::nodepp::lib::net::NetSocketStream> index_sockets;
+					bool has_translated = false;
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						std::copy( colours.begin( ), colours.end( ), m_palette.begin( ) + first_colour );
+						buffer = create_colour_map_message( first_colour, static_cast<uint16_t>( colours.size( ) ) );
+						m_clients.for_each( [&]( Client &client ) {
+							if( client.format.translated ) {
+								has_translated = true;
+							} else {
+								index_sockets.push_back( client.socket );
+							}
+						} );
+					}
+					record( RecordDirection::server_to_client, *buffer );
+					// Clients shown the palette indices look the new colours up themselves
+					for( auto const &socket : index_sockets ) {
+						socket->write( *buffer );
+					}
+					if( has_translated ) {
+						// Translated pixels hold the old colours, so they are all sent again
+						add_update_request( 0, 0, m_width, m_height );
+					}
+				}
+
+				void on_client_scale(
+				    std::function<uint8_t( std::string const &remote_address, uint16_t remote_port )> callback ) {
+					std::lock_guard<std::mutex> lock{m_clients_mutex};
+					m_scale_selector = std::move( callback );
 				}
 
 				void on_key_event( std::function<void( bool key_down, uint32_t key )> callback ) {
-					m_server->emitter( )->on( "on_key_event", std::move( callback ) );
+					m_emitter->on( "on_key_event", std::move( callback ) );
 				}
 
 				void emit_key_event( bool key_down, uint32_t key ) {
-					m_server->emitter( )->emit( "on_key_event", key_down, key );
+					m_emitter->emit( "on_key_event", key_down, key );
 				}
 
 				void on_pointer_event(
 				    std::function<void( ButtonMask buttons, uint16_t x_position, uint16_t y_position )> callback ) {
-					m_server->emitter( )->on( "on_pointer_event", std::move( callback ) );
+					m_emitter->on( "on_pointer_event", std::move( callback ) );
 				}
 
 				void emit_pointer_event( ButtonMask buttons, uint16_t x_position, uint16_t y_position ) {
-					m_server->emitter( )->emit( "on_pointer_event", buttons, x_position, y_position );
+					m_emitter->emit( "on_pointer_event", buttons, x_position, y_position );
 				}
 
 				void on_client_clipboard_text( std::function<void( daw::string_view text )> callback ) {
-					m_server->emitter( )->on( "on_clipboard_text", std::move( callback ) );
+					m_emitter->on( "on_clipboard_text", std::move( callback ) );
 				}
 
 				void emit_client_clipboard_text( daw::string_view text ) {
-					m_server->emitter( )->emit( "on_clipboard_text", text );
+					m_emitter->emit( "on_clipboard_text", text );
 				}
 
 				void send_clipboard_text( daw::string_view text ) {
-					daw::exception::daw_throw_on_false( text.size( ) <= std::numeric_limits<uint32_t>::max( ),
+					daw::exception::daw_throw_on_false( text.size( ) <= std::numeric_limits<int32_t>::max( ),
 					                                    "Invalid text size" );
-					auto buffer = std::make_shared<daw::nodepp::base::data_t>( );
-					buffer->push_back( 0 ); // Message Type, ServerCutText
-					buffer->push_back( 0 ); // Padding
-					buffer->push_back( 0 ); // Padding
-					buffer->push_back( 0 ); // Padding
+					std::vector<daw::nodepp::lib::net::NetSocketStream> notify_sockets;
+					std::vector<daw::nodepp::lib::net::NetSocketStream> provide_sockets;
+					std::vector<daw::nodepp::lib::net::NetSocketStream> legacy_sockets;
+					{
+						std::lock_guard<std::mutex> lock{m_clients_mutex};
+						if( !m_clipboard.assign( text ) ) {
+							return;
+						}
+						m_clipboard_provide.reset( );
+						m_clients.for_each( [&]( Client &client ) {
+							if( !client.extended_clipboard ) {
+								legacy_sockets.push_back( client.socket );
+								return;
+							}
+							auto const caps = client.clipboard_caps;
+							if( !( caps & ExtendedClipboard::text ) ) {
+								return;
+							}
+							// Text the client will take unasked is sent straight away, as is text for a client
+							// that cannot ask for it.  Otherwise it is told there is new text and asks when it wants
+							auto const can_ask =
+							    ( caps & ExtendedClipboard::notify ) && ( caps & ExtendedClipboard::request );
+							auto const can_provide = ( caps & ExtendedClipboard::provide ) != 0;
+							if( can_provide && ( text.size( ) <= client.max_text_size || !can_ask ) ) {
+								provide_sockets.push_back( client.socket );
+							} else if( can_ask ) {
+								notify_sockets.push_back( client.socket );
+							}
+						} );
+					}
 
-					append( *buffer, text );
+					if( !notify_sockets.empty( ) ) {
+						auto const notify = create_extended_clipboard_message(
+						    ExtendedClipboard::notify | ExtendedClipboard::text, nullptr, 0 );
+						for( auto const &socket : notify_sockets ) {
+							socket->write( *notify );
+						}
+					}
+					if( !provide_sockets.empty( ) ) {
+						auto const provide = get_clipboard_provide_message( );
+						for( auto const &socket : provide_sockets ) {
+							socket->write( *provide );
+						}
+					}
+					// Recordings hold the plain message whichever form the clients were sent
+					if( !legacy_sockets.empty( ) || std::atomic_load( &m_recorder ) ) {
+						auto buffer = m_buffer_pool->acquire( );
+						buffer->push_back( 3 ); // Message Type, ServerCutText
+						buffer->push_back( 0 ); // Padding
+						buffer->push_back( 0 ); // Padding
+						buffer->push_back( 0 ); // Padding
+						append( *buffer, to_bytes( network_byte_order( static_cast<uint32_t>( text.size( ) ) ) ) );
+						buffer->insert( buffer->end( ), text.begin( ), text.end( ) );
+						record( RecordDirection::server_to_client, *buffer );
+						for( auto const &socket : legacy_sockets ) {
+							socket->write( *buffer );
+						}
+					}
+				}
 
-					send_all( buffer );
+				void set_max_clipboard_size( size_t size ) {
+					m_max_clipboard_size.store( size );
 				}
 
 				void send_bell( ) {
-					auto buffer = std::make_shared<daw::nodepp::base::data_t>( 1, 2 );
+					auto buffer = m_buffer_pool->acquire( );
+					buffer->push_back( 2 ); // Message Type, Bell
 					send_all( buffer );
 				}
 
+				void start_recording( std::string file_name, std::chrono::seconds keyframe_interval ) {
+					auto recorder = std::make_shared<SessionRecorder>( std::move( file_name ), m_width, m_height,
+					                                                   m_bit_depth, keyframe_interval );
+					recorder->append( RecordDirection::keyframe, m_buffer.data( ), m_buffer.size( ) );
+					std::atomic_store( &m_recorder, std::move( recorder ) );
+				}
+
+				void stop_recording( ) {
+					auto recorder = std::atomic_exchange( &m_recorder, std::shared_ptr<SessionRecorder>{} );
+					if( recorder ) {
+						recorder->close( );
+					}
+				}
+
+				ReplayStats replay( std::string const &file_name, ReplaySpeed::values speed,
+				                    std::chrono::microseconds start_at ) {
+					SessionRecording recording{file_name};
+					daw::exception::daw_throw_on_false( recording.width( ) == m_width &&
+					                                        recording.height( ) == m_height &&
+					                                        recording.bit_depth( ) == m_bit_depth,
+					                                    "Recording does not match the framebuffer" );
+
+					ReplayStats result{0, 0, std::chrono::microseconds( 0 )};
+					auto const &records = recording.records( );
+					auto const first = recording.seek( start_at );
+					if( first >= records.size( ) ) {
+						return result;
+					}
+					// Records between the keyframe and start_at are sent without delay
+					auto const base_timestamp = std::max( records[first].timestamp, start_at );
+					auto const start = std::chrono::steady_clock::now( );
+					// The recording is played from its own framebuffer so that the live one is left untouched, and
+					// is not recorded again if a recording is running
+					std::vector<uint8_t> framebuffer( m_buffer.size( ) );
+
+					for( auto n = first; n < records.size( ); ++n ) {
+						auto const &rec = records[n];
+						if( rec.direction == RecordDirection::client_to_server ) {
+							continue;
+						}
+						if( speed == ReplaySpeed::real_time && rec.timestamp > base_timestamp ) {
+							std::this_thread::sleep_until( start + ( rec.timestamp - base_timestamp ) );
+						}
+						++result.messages;
+						result.bytes += rec.size;
+						// Pixels are sent through the same path as live updates so that scaled and colour mapped
+						// clients get them in their own format
+						if( rec.direction == RecordDirection::keyframe ) {
+							daw::exception::daw_throw_on_false( restore_keyframe( rec, framebuffer ),
+							                                    "Invalid keyframe" );
+							write_updates( framebuffer, {Update{0, 0, m_width, m_height}}, false );
+						} else if( rec.size > 0 && rec.data[0] == 0 ) { // FrameBufferUpdate
+							std::vector<Update> areas;
+							daw::exception::daw_throw_on_false(
+							    apply_update_message( rec, m_width, m_height, bytes_per_pixel( ), framebuffer, areas ),
+							    "Invalid update in recording" );
+							write_updates( framebuffer, areas, false );
+						} else {
+							auto buffer = m_buffer_pool->acquire( );
+							buffer->assign( rec.data, rec.data + rec.size );
+							write_all( *buffer );
+						}
+					}
+					result.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+					    std::chrono::steady_clock::now( ) - start );
+					return result;
+				}
+
 				void listen( uint16_t port, daw::nodepp::lib::net::ip_version ip_ver ) {
+					// The server is only created when listening on our own port, sessions hosted by an
+					// RFBSessionHost receive their sockets from the host
+					if( !m_server ) {
+						m_server = daw::nodepp::lib::net::create_net_server( m_emitter );
+						setup_callbacks( );
+					}
 					m_server->listen( port, ip_ver );
 					// m_service_thread = std::thread( []( ) {
 					daw::nodepp::base::start_service( daw::nodepp::base::StartServiceMode::Single );
@@ -433,16 +1554,83 @@ namespace daw {
 
 				void close( ) {
 					daw::nodepp::base::ServiceHandle::stop( );
-					m_service_thread.join( );
+					if( m_service_thread.joinable( ) ) {
+						m_service_thread.join( );
+					}
+				}
+
+				void close_clients( ) {
+					// A default ClientId never matches a client so this closes them all
+					close_all_except( ClientId{} );
 				}
 
 			}; // class RFBServerImpl
+
+			class RFBSessionHostImpl final : public std::enable_shared_from_this<RFBSessionHostImpl> {
+				SessionDirectory<RFBServerImpl> m_sessions;
+				std::shared_ptr<BufferPool> m_buffer_pool;
+				daw::nodepp::lib::net::NetServer m_server;
+				bool m_callbacks_setup;
+
+				void setup_callbacks( ) {
+					std::weak_ptr<RFBSessionHostImpl> weak_self = shared_from_this( );
+					m_server->on_connection( [weak_self]( auto socket ) {
+						std::cout << "Connection from: " << socket->remote_address( ) << ":" << socket->remote_port( )
+						          << std::endl;
+						perform_handshake( socket, [weak_self]( auto s, bool shared ) {
+							if( auto self = weak_self.lock( ) ) {
+								self->m_sessions.route( s, shared );
+							} else {
+								s->close( );
+							}
+						} );
+					} );
+					m_callbacks_setup = true;
+				}
+
+			  public:
+				explicit RFBSessionHostImpl( daw::nodepp::base::EventEmitter emitter )
+				    : m_sessions{}
+				    , m_buffer_pool{create_buffer_pool( )}
+				    , m_server{daw::nodepp::lib::net::create_net_server( std::move( emitter ) )}
+				    , m_callbacks_setup{false} {}
+
+				std::shared_ptr<RFBServerImpl> create_session( std::string name, uint16_t width, uint16_t height,
+				                                               uint8_t bit_depth ) {
+					auto session = std::make_shared<RFBServerImpl>(
+					    width, height, bit_depth, daw::nodepp::base::create_event_emitter( ), m_buffer_pool );
+					m_sessions.add( std::move( name ), session );
+					return session;
+				}
+
+				void remove_session( std::string const &name ) {
+					m_sessions.remove( name );
+				}
+
+				void on_route( SessionDirectory<RFBServerImpl>::router_t router ) {
+					m_sessions.on_route( std::move( router ) );
+				}
+
+				void listen( uint16_t port, daw::nodepp::lib::net::ip_version ip_ver ) {
+					if( !m_callbacks_setup ) {
+						setup_callbacks( );
+					}
+					m_server->listen( port, ip_ver );
+					daw::nodepp::base::start_service( daw::nodepp::base::StartServiceMode::Single );
+				}
+
+				void close( ) {
+					daw::nodepp::base::ServiceHandle::stop( );
+				}
+			}; // class RFBSessionHostImpl
 		}      // namespace impl
 
 		RFBServer::RFBServer( uint16_t width, uint16_t height, BitDepth::values depth,
 		                      daw::nodepp::base::EventEmitter emitter )
 		    : m_impl( std::make_shared<impl::RFBServerImpl>( width, height, impl::get_bit_depth( depth ),
-		                                                     std::move( emitter ) ) ) {}
+		                                                     std::move( emitter ), impl::create_buffer_pool( ) ) ) {}
+
+		RFBServer::RFBServer( std::shared_ptr<impl::RFBServerImpl> server_impl ) : m_impl( std::move( server_impl ) ) {}
 
 		RFBServer::~RFBServer( ) = default;
 
@@ -470,6 +1658,11 @@ namespace daw {
 			m_impl->close( );
 		}
 
+		void RFBServer::on_client_scale(
+		    std::function<uint8_t( std::string const &remote_address, uint16_t remote_port )> callback ) {
+			m_impl->on_client_scale( std::move( callback ) );
+		}
+
 		void RFBServer::on_key_event( std::function<void( bool key_down, uint32_t key )> callback ) {
 			m_impl->on_key_event( std::move( callback ) );
 		}
@@ -487,6 +1680,10 @@ namespace daw {
 			m_impl->send_clipboard_text( text );
 		}
 
+		void RFBServer::set_max_clipboard_size( size_t size ) {
+			m_impl->set_max_clipboard_size( size );
+		}
+
 		void RFBServer::send_bell( ) {
 			m_impl->send_bell( );
 		}
@@ -502,5 +1699,49 @@ namespace daw {
 		void RFBServer::update( ) {
 			m_impl->update( );
 		}
+
+		void RFBServer::set_palette( uint8_t first_colour, std::vector<Colour> const &colours ) {
+			m_impl->set_palette( first_colour, colours );
+		}
+
+		void RFBServer::start_recording( std::string file_name, std::chrono::seconds keyframe_interval ) {
+			m_impl->start_recording( std::move( file_name ), keyframe_interval );
+		}
+
+		void RFBServer::stop_recording( ) {
+			m_impl->stop_recording( );
+		}
+
+		ReplayStats RFBServer::replay( std::string const &file_name, ReplaySpeed::values speed,
+		                               std::chrono::microseconds start_at ) {
+			return m_impl->replay( file_name, speed, start_at );
+		}
+
+		RFBSessionHost::RFBSessionHost( daw::nodepp::base::EventEmitter emitter )
+		    : m_impl( std::make_shared<impl::RFBSessionHostImpl>( std::move( emitter ) ) ) {}
+
+		RFBSessionHost::~RFBSessionHost( ) = default;
+
+		RFBServer RFBSessionHost::create_session( std::string name, uint16_t width, uint16_t height,
+		                                          BitDepth::values depth ) {
+			return RFBServer{m_impl->create_session( std::move( name ), width, height, impl::get_bit_depth( depth ) )};
+		}
+
+		void RFBSessionHost::remove_session( std::string const &name ) {
+			m_impl->remove_session( name );
+		}
+
+		void RFBSessionHost::on_route(
+		    std::function<std::string( std::string const &remote_address, uint16_t remote_port )> router ) {
+			m_impl->on_route( std::move( router ) );
+		}
+
+		void RFBSessionHost::listen( uint16_t port, daw::nodepp::lib::net::ip_version ip_ver ) {
+			m_impl->listen( port, ip_ver );
+		}
+
+		void RFBSessionHost::close( ) {
+			m_impl->close( );
+		}
 	} // namespace rfb
 } // namespace daw
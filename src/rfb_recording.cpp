@@ -0,0 +1,198 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2017 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+#include <daw/daw_exception.h>
+
+#include "rfb_recording.h"
+
+namespace daw {
+	namespace rfb {
+		namespace {
+			constexpr char const recording_magic[] = "NPPRFBRC";
+			constexpr uint32_t recording_version = 1;
+			constexpr size_t recording_initial_size = 16 * 1024 * 1024;
+		} // namespace
+
+		SessionRecorder::SessionRecorder( std::string file_name, uint16_t width, uint16_t height, uint8_t bit_depth,
+		                                  std::chrono::microseconds keyframe_interval )
+		    : m_file_name{std::move( file_name )}
+		    , m_file{}
+		    , m_position{sizeof( RecordingFileHeader )}
+		    , m_start{}
+		    , m_keyframe_interval{keyframe_interval}
+		    , m_last_keyframe{0} {
+
+			boost::iostreams::mapped_file_params params{m_file_name};
+			params.flags = boost::iostreams::mapped_file::readwrite;
+			params.new_file_size = static_cast<boost::iostreams::stream_offset>( recording_initial_size );
+			m_file.open( params );
+			daw::exception::daw_throw_on_false( m_file.is_open( ), "Could not create recording file" );
+
+			RecordingFileHeader hdr{};
+			std::copy( recording_magic, recording_magic + sizeof( hdr.magic ), hdr.magic );
+			hdr.version = recording_version;
+			hdr.width = width;
+			hdr.height = height;
+			hdr.bit_depth = bit_depth;
+			hdr.data_size = 0;
+			std::memcpy( m_file.data( ), &hdr, sizeof( hdr ) );
+			m_start = std::chrono::steady_clock::now( );
+		}
+
+		SessionRecorder::~SessionRecorder( ) {
+			try {
+				close( );
+			} catch( ... ) {}
+		}
+
+		RecordingFileHeader &SessionRecorder::header( ) noexcept {
+			return *reinterpret_cast<RecordingFileHeader *>( m_file.data( ) );
+		}
+
+		void SessionRecorder::reserve( size_t additional_size ) {
+			auto const required = m_position + additional_size;
+			if( required <= m_file.size( ) ) {
+				return;
+			}
+			auto new_size = m_file.size( ) * 2;
+			while( new_size < required ) {
+				new_size *= 2;
+			}
+			m_file.close( );
+			boost::filesystem::resize_file( m_file_name, new_size );
+
+			boost::iostreams::mapped_file_params params{m_file_name};
+			params.flags = boost::iostreams::mapped_file::readwrite;
+			m_file.open( params );
+			daw::exception::daw_throw_on_false( m_file.is_open( ), "Could not grow recording file" );
+		}
+
+		void SessionRecorder::append( RecordDirection::values direction, uint8_t const *data, size_t size ) {
+			daw::exception::daw_throw_on_false( size <= std::numeric_limits<uint32_t>::max( ), "Invalid record size" );
+			std::lock_guard<std::mutex> lock{m_mutex};
+			if( !m_file.is_open( ) ) {
+				return;
+			}
+			reserve( sizeof( RecordHeader ) + size );
+
+			RecordHeader hdr{};
+			hdr.timestamp = static_cast<uint64_t>( elapsed( ).count( ) );
+			hdr.size = static_cast<uint32_t>( size );
+			hdr.direction = direction;
+
+			std::memcpy( m_file.data( ) + m_position, &hdr, sizeof( hdr ) );
+			std::memcpy( m_file.data( ) + m_position + sizeof( hdr ), data, size );
+			m_position += sizeof( hdr ) + size;
+			if( direction == RecordDirection::keyframe ) {
+				m_last_keyframe = std::chrono::microseconds( hdr.timestamp );
+			}
+			// Only publish the record once it is complete
+			header( ).data_size = m_position - sizeof( RecordingFileHeader );
+		}
+
+		std::chrono::microseconds SessionRecorder::elapsed( ) const {
+			return std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now( ) -
+			                                                              m_start );
+		}
+
+		bool SessionRecorder::keyframe_due( ) {
+			std::lock_guard<std::mutex> lock{m_mutex};
+			return m_position == sizeof( RecordingFileHeader ) || elapsed( ) - m_last_keyframe >= m_keyframe_interval;
+		}
+
+		void SessionRecorder::close( ) {
+			std::lock_guard<std::mutex> lock{m_mutex};
+			if( !m_file.is_open( ) ) {
+				return;
+			}
+			m_file.close( );
+			boost::filesystem::resize_file( m_file_name, m_position );
+		}
+
+		SessionRecording::SessionRecording( std::string const &file_name )
+		    : m_file{file_name}, m_header{}, m_records{}, m_keyframes{} {
+
+			daw::exception::daw_throw_on_false( m_file.is_open( ), "Could not open recording file" );
+			daw::exception::daw_throw_on_false( m_file.size( ) >= sizeof( RecordingFileHeader ),
+			                                    "Invalid recording file" );
+			std::memcpy( &m_header, m_file.data( ), sizeof( m_header ) );
+			daw::exception::daw_throw_on_false(
+			    std::equal( m_header.magic, m_header.magic + sizeof( m_header.magic ), recording_magic ),
+			    "Invalid recording file" );
+			daw::exception::daw_throw_on_false( m_header.version == recording_version,
+			                                    "Unsupported recording version" );
+
+			auto const first = reinterpret_cast<uint8_t const *>( m_file.data( ) );
+			auto const last = first + sizeof( RecordingFileHeader ) +
+			                  std::min<size_t>( m_header.data_size, m_file.size( ) - sizeof( RecordingFileHeader ) );
+
+			auto pos = first + sizeof( RecordingFileHeader );
+			while( static_cast<size_t>( last - pos ) >= sizeof( RecordHeader ) ) {
+				RecordHeader hdr{};
+				std::memcpy( &hdr, pos, sizeof( hdr ) );
+				pos += sizeof( hdr );
+				if( static_cast<size_t>( last - pos ) < hdr.size ) {
+					break;
+				}
+				auto const direction = static_cast<RecordDirection::values>( hdr.direction );
+				if( direction == RecordDirection::keyframe ) {
+					m_keyframes.push_back( m_records.size( ) );
+				}
+				m_records.push_back( {std::chrono::microseconds( hdr.timestamp ), direction, pos, hdr.size} );
+				pos += hdr.size;
+			}
+		}
+
+		uint16_t SessionRecording::width( ) const noexcept {
+			return m_header.width;
+		}
+
+		uint16_t SessionRecording::height( ) const noexcept {
+			return m_header.height;
+		}
+
+		uint8_t SessionRecording::bit_depth( ) const noexcept {
+			return m_header.bit_depth;
+		}
+
+		std::vector<Record> const &SessionRecording::records( ) const noexcept {
+			return m_records;
+		}
+
+		size_t SessionRecording::seek( std::chrono::microseconds timestamp ) const {
+			auto pos = std::upper_bound( m_keyframes.begin( ), m_keyframes.end( ), timestamp,
+			                             [&]( std::chrono::microseconds ts, size_t idx ) {
+				                             return ts < m_records[idx].timestamp;
+			                             } );
+			if( pos == m_keyframes.begin( ) ) {
+				return 0;
+			}
+			return *std::prev( pos );
+		}
+	} // namespace rfb
+} // namespace daw
@@ -0,0 +1,301 @@
+// The MIT License (MIT)
+//
+// Copyright (c) 2014-2017 Darrell Wright
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files( the "Software" ), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#define BOOST_TEST_DYN_LINK
+#define BOOST_TEST_MODULE nodepp_rfb_unit_test
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rfb_client_registry.h"
+#include "rfb_clipboard.h"
+#include "rfb_pixels.h"
+#include "rfb_recording.h"
+#include "rfb_replay.h"
+#include "rfb_session_directory.h"
+
+BOOST_AUTO_TEST_CASE( recording_seek_001 ) {
+	auto const file_name = ( boost::filesystem::temp_directory_path( ) / boost::filesystem::unique_path( ) ).string( );
+	std::vector<uint8_t> const frame( 4 * 4 * 4, 1 );
+	std::vector<uint8_t> const message{0, 0, 0, 0};
+	{
+		daw::rfb::SessionRecorder recorder{file_name, 4, 4, 32, std::chrono::microseconds( 0 )};
+		recorder.append( daw::rfb::RecordDirection::keyframe, frame.data( ), frame.size( ) );
+		recorder.append( daw::rfb::RecordDirection::server_to_client, message.data( ), message.size( ) );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 2 ) );
+		recorder.append( daw::rfb::RecordDirection::keyframe, frame.data( ), frame.size( ) );
+		recorder.append( daw::rfb::RecordDirection::client_to_server, message.data( ), message.size( ) );
+		recorder.close( );
+	}
+	{
+		daw::rfb::SessionRecording recording{file_name};
+		BOOST_REQUIRE_EQUAL( recording.width( ), 4 );
+		BOOST_REQUIRE_EQUAL( recording.height( ), 4 );
+		BOOST_REQUIRE_EQUAL( recording.bit_depth( ), 32 );
+		auto const &records = recording.records( );
+		BOOST_REQUIRE_EQUAL( records.size( ), 4 );
+		BOOST_REQUIRE( records[0].direction == daw::rfb::RecordDirection::keyframe );
+		BOOST_REQUIRE( std::equal( frame.begin( ), frame.end( ), records[0].data ) );
+		BOOST_REQUIRE( records[3].direction == daw::rfb::RecordDirection::client_to_server );
+		BOOST_REQUIRE_EQUAL( records[3].size, message.size( ) );
+
+		BOOST_REQUIRE_EQUAL( recording.seek( records[1].timestamp ), 0 );
+		BOOST_REQUIRE_EQUAL( recording.seek( records[2].timestamp ), 2 );
+		BOOST_REQUIRE_EQUAL( recording.seek( records[3].timestamp + std::chrono::seconds( 1 ) ), 2 );
+	}
+	boost::filesystem::remove( file_name );
+}
+
+namespace {
+	void append_network_uint16( std::vector<uint8_t> &buffer, uint16_t value ) {
+		buffer.push_back( static_cast<uint8_t>( value >> 8u ) );
+		buffer.push_back( static_cast<uint8_t>( value & 0xFFu ) );
+	}
+
+	void append_raw_rectangle( std::vector<uint8_t> &buffer, uint16_t x, uint16_t y, uint16_t width,
+	                           uint16_t height, uint8_t value ) {
+		append_network_uint16( buffer, x );
+		append_network_uint16( buffer, y );
+		append_network_uint16( buffer, width );
+		append_network_uint16( buffer, height );
+		buffer.insert( buffer.end( ), 4, 0 ); // Encoding type RAW
+		buffer.insert( buffer.end( ), static_cast<size_t>( width * height * 4 ), value );
+	}
+
+	daw::rfb::Record make_record( daw::rfb::RecordDirection::values direction, std::vector<uint8_t> const &data,
+	                              size_t size ) {
+		return daw::rfb::Record{std::chrono::microseconds( 0 ), direction, data.data( ), size};
+	}
+} // namespace
+
+BOOST_AUTO_TEST_CASE( replay_001 ) {
+	using daw::rfb::RecordDirection::keyframe;
+	using daw::rfb::RecordDirection::server_to_client;
+	std::vector<uint8_t> framebuffer( 4 * 2 * 4, 0 );
+
+	std::vector<uint8_t> const frame( framebuffer.size( ), 7 );
+	BOOST_REQUIRE( daw::rfb::impl::restore_keyframe( make_record( keyframe, frame, frame.size( ) ), framebuffer ) );
+	BOOST_REQUIRE( framebuffer == frame );
+	BOOST_REQUIRE(
+	    !daw::rfb::impl::restore_keyframe( make_record( keyframe, frame, frame.size( ) - 1 ), framebuffer ) );
+
+	std::vector<uint8_t> message{0, 0};
+	append_network_uint16( message, 2 );
+	append_raw_rectangle( message, 1, 0, 2, 1, 1 );
+	append_raw_rectangle( message, 3, 1, 1, 1, 2 );
+	std::vector<daw::rfb::impl::Update> areas;
+	BOOST_REQUIRE( daw::rfb::impl::apply_update_message( make_record( server_to_client, message, message.size( ) ), 4,
+	                                                     2, 4, framebuffer, areas ) );
+	BOOST_REQUIRE_EQUAL( areas.size( ), 2 );
+	BOOST_REQUIRE_EQUAL( areas[1].x, 3 );
+	BOOST_REQUIRE_EQUAL( areas[1].y, 1 );
+	std::vector<uint8_t> expected( frame );
+	std::fill( expected.begin( ) + 4, expected.begin( ) + 12, 1 );
+	std::fill( expected.begin( ) + 28, expected.end( ), 2 );
+	BOOST_REQUIRE( framebuffer == expected );
+
+	// A message cut short is rejected
+	areas.clear( );
+	BOOST_REQUIRE( !daw::rfb::impl::apply_update_message(
+	    make_record( server_to_client, message, message.size( ) - 1 ), 4, 2, 4, framebuffer, areas ) );
+	BOOST_REQUIRE( !daw::rfb::impl::apply_update_message( make_record( server_to_client, message, 2 ), 4, 2, 4,
+	                                                      framebuffer, areas ) );
+
+	// As is a rectangle outside of the framebuffer
+	std::vector<uint8_t> outside{0, 0};
+	append_network_uint16( outside, 1 );
+	append_raw_rectangle( outside, 3, 0, 2, 1, 3 );
+	areas.clear( );
+	BOOST_REQUIRE( !daw::rfb::impl::apply_update_message( make_record( server_to_client, outside, outside.size( ) ),
+	                                                      4, 2, 4, framebuffer, areas ) );
+	BOOST_REQUIRE( areas.empty( ) );
+	BOOST_REQUIRE( framebuffer == expected );
+}
+
+namespace {
+	struct TestSocket {
+		std::string address;
+		bool closed;
+
+		std::string remote_address( ) const {
+			return address;
+		}
+
+		uint16_t remote_port( ) const {
+			return 5900;
+		}
+
+		void close( ) {
+			closed = true;
+		}
+	}; // struct TestSocket
+
+	struct TestSession {
+		std::vector<std::shared_ptr<TestSocket>> clients;
+		size_t closed_count;
+
+		void attach_client( std::shared_ptr<TestSocket> socket, bool ) {
+			clients.push_back( std::move( socket ) );
+		}
+
+		void close_clients( ) {
+			++closed_count;
+		}
+	}; // struct TestSession
+} // namespace
+
+BOOST_AUTO_TEST_CASE( session_directory_001 ) {
+	daw::rfb::impl::SessionDirectory<TestSession> sessions;
+	auto const first = std::make_shared<TestSession>( );
+	auto const second = std::make_shared<TestSession>( );
+	sessions.add( "first", first );
+	sessions.add( "second", second );
+
+	// Without a router clients go to the first session added
+	auto const a = std::make_shared<TestSocket>( TestSocket{"10.0.0.1", false} );
+	sessions.route( a, true );
+	BOOST_REQUIRE_EQUAL( first->clients.size( ), 1 );
+	BOOST_REQUIRE( first->clients.front( ) == a );
+
+	sessions.on_route( []( std::string const &remote_address, uint16_t ) {
+		return remote_address == "10.0.0.2" ? std::string{"second"} : std::string{"missing"};
+	} );
+	auto const b = std::make_shared<TestSocket>( TestSocket{"10.0.0.2", false} );
+	sessions.route( b, true );
+	BOOST_REQUIRE_EQUAL( second->clients.size( ), 1 );
+	BOOST_REQUIRE( !b->closed );
+
+	// A client routed to a session that does not exist is closed
+	auto const c = std::make_shared<TestSocket>( TestSocket{"10.0.0.3", false} );
+	sessions.route( c, true );
+	BOOST_REQUIRE( c->closed );
+	BOOST_REQUIRE_EQUAL( first->clients.size( ), 1 );
+	BOOST_REQUIRE_EQUAL( second->clients.size( ), 1 );
+
+	// Removing a session closes its clients and later clients routed to it
+	sessions.remove( "second" );
+	BOOST_REQUIRE_EQUAL( second->closed_count, 1 );
+	BOOST_REQUIRE_EQUAL( first->closed_count, 0 );
+	auto const d = std::make_shared<TestSocket>( TestSocket{"10.0.0.2", false} );
+	sessions.route( d, true );
+	BOOST_REQUIRE( d->closed );
+	BOOST_REQUIRE_EQUAL( second->clients.size( ), 1 );
+}
+
+BOOST_AUTO_TEST_CASE( client_registry_001 ) {
+	daw::rfb::impl::ClientRegistry<int> registry;
+	auto const a = registry.add( 1 );
+	auto const b = registry.add( 2 );
+	auto const c = registry.add( 3 );
+	BOOST_REQUIRE_EQUAL( registry.size( ), 3 );
+
+	BOOST_REQUIRE( registry.remove( b ) );
+	BOOST_REQUIRE( !registry.remove( b ) );
+	BOOST_REQUIRE( registry.find( b ) == nullptr );
+	BOOST_REQUIRE_EQUAL( *registry.find( a ), 1 );
+	BOOST_REQUIRE_EQUAL( *registry.find( c ), 3 );
+
+	// The freed slot is reused with a new generation so the old id stays invalid
+	auto const d = registry.add( 4 );
+	BOOST_REQUIRE_EQUAL( d.index, b.index );
+	BOOST_REQUIRE( d.generation != b.generation );
+	BOOST_REQUIRE( registry.find( b ) == nullptr );
+	BOOST_REQUIRE_EQUAL( *registry.find( d ), 4 );
+	BOOST_REQUIRE( registry.find( daw::rfb::impl::ClientId{} ) == nullptr );
+	BOOST_REQUIRE_EQUAL( registry.size( ), 3 );
+}
+
+BOOST_AUTO_TEST_CASE( colour_cube_quantizer_001 ) {
+	daw::rfb::impl::ColourCubeQuantizer const quantizer{};
+	// The cube is red major with 6 levels a channel, 51 apart
+	BOOST_REQUIRE_EQUAL( quantizer( 0, 0, 0 ), 0 );
+	BOOST_REQUIRE_EQUAL( quantizer( 0, 0, 255 ), 5 );
+	BOOST_REQUIRE_EQUAL( quantizer( 0, 255, 0 ), 30 );
+	BOOST_REQUIRE_EQUAL( quantizer( 255, 0, 0 ), 180 );
+	BOOST_REQUIRE_EQUAL( quantizer( 255, 255, 255 ), 215 );
+	BOOST_REQUIRE_EQUAL( quantizer( 102, 153, 51 ), 2 * 36 + 3 * 6 + 1 );
+	// Values round to the nearest level
+	BOOST_REQUIRE_EQUAL( quantizer( 25, 0, 0 ), 0 );
+	BOOST_REQUIRE_EQUAL( quantizer( 26, 0, 0 ), 36 );
+
+	std::vector<uint8_t> const pixels{255, 255, 255, 0, 0, 0, 255, 0};
+	std::vector<uint8_t> indices;
+	daw::rfb::impl::append_quantized( pixels.begin( ), pixels.end( ), indices );
+	BOOST_REQUIRE_EQUAL( indices.size( ), 2 );
+	BOOST_REQUIRE_EQUAL( indices[0], 215 );
+	BOOST_REQUIRE_EQUAL( indices[1], 5 );
+}
+
+BOOST_AUTO_TEST_CASE( scale_update_001 ) {
+	using daw::rfb::impl::Update;
+	using daw::rfb::impl::scale_update;
+	// A 64x48 framebuffer viewed at half size is 32x24
+	auto const inside = scale_update( Update{3, 5, 4, 4}, 2, 32, 24 );
+	BOOST_REQUIRE_EQUAL( inside.x, 1 );
+	BOOST_REQUIRE_EQUAL( inside.y, 2 );
+	BOOST_REQUIRE_EQUAL( inside.width, 3 );
+	BOOST_REQUIRE_EQUAL( inside.height, 3 );
+
+	auto const edge = scale_update( Update{62, 46, 10, 10}, 2, 32, 24 );
+	BOOST_REQUIRE_EQUAL( edge.x, 31 );
+	BOOST_REQUIRE_EQUAL( edge.y, 23 );
+	BOOST_REQUIRE_EQUAL( edge.width, 1 );
+	BOOST_REQUIRE_EQUAL( edge.height, 1 );
+
+	// 65 / 3 leaves a column that is not part of the view
+	auto const outside = scale_update( Update{64, 0, 1, 10}, 3, 21, 16 );
+	BOOST_REQUIRE_EQUAL( outside.width, 0 );
+}
+
+BOOST_AUTO_TEST_CASE( cut_text_001 ) {
+	daw::rfb::impl::CutTextTransfer transfer{10, false, 100};
+	BOOST_REQUIRE_EQUAL( transfer.add( "hello", 5 ), 5 );
+	BOOST_REQUIRE( !transfer.complete( ) );
+	// Data past the end of the message is left for the next message
+	BOOST_REQUIRE_EQUAL( transfer.add( "world\x04", 6 ), 5 );
+	BOOST_REQUIRE( transfer.complete( ) );
+	BOOST_REQUIRE_EQUAL( transfer.data, "helloworld" );
+
+	daw::rfb::impl::CutTextTransfer too_large{20, false, 10};
+	BOOST_REQUIRE( too_large.discard );
+	BOOST_REQUIRE_EQUAL( too_large.add( "0123456789", 10 ), 10 );
+	BOOST_REQUIRE_EQUAL( too_large.add( "0123456789", 10 ), 10 );
+	BOOST_REQUIRE( too_large.complete( ) );
+	BOOST_REQUIRE( too_large.data.empty( ) );
+
+	daw::rfb::impl::ClipboardText clipboard;
+	BOOST_REQUIRE( !clipboard.has_text( ) );
+	BOOST_REQUIRE( clipboard.assign( "abc" ) );
+	auto const version = clipboard.version( );
+	BOOST_REQUIRE( !clipboard.assign( "abc" ) );
+	BOOST_REQUIRE_EQUAL( clipboard.version( ), version );
+	BOOST_REQUIRE( clipboard.assign( "abd" ) );
+	BOOST_REQUIRE( clipboard.version( ) != version );
+	BOOST_REQUIRE( clipboard.has_text( ) );
+	BOOST_REQUIRE_EQUAL( clipboard.text( ), "abd" );
+}